@@ -0,0 +1,24 @@
+// The dump area is reserved at the end of the image built by the Makefile
+// .img target, right after the 20 MiB FAT filesystem. The first sector holds
+// the header, the data starts at the following one.
+#define AHCI_DUMP_LBA_START 40960
+#define AHCI_DUMP_SECTORS 32768
+#define AHCI_DUMP_MAGIC "LPDOSDMP"
+#define AHCI_DUMP_VERSION 1
+
+#define AHCI_SECTOR_SIZE 512
+
+struct ahci_dump_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t truncated;
+    uint64_t length;
+} __attribute__((packed));
+
+int ahci_dump_initialize();
+
+void ahci_dump_write(
+    const char* data,
+    size_t length);
+
+void ahci_dump_flush();
@@ -0,0 +1,9 @@
+void cmdline_initialize(
+    const char* cmdline);
+
+const char* cmdline_get_option(
+    const char* key,
+    size_t* value_length);
+
+int cmdline_has_option(
+    const char* key);
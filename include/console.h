@@ -1,5 +1,54 @@
+#define CONSOLE_SINKS_MAX 8
+
+// Streams a sink can be subscribed to, text is the human readable scan output
+// while dump is meant for bulk data that should go to the fastest sink
+#define CONSOLE_STREAM_TEXT (1 << 0)
+#define CONSOLE_STREAM_DUMP (1 << 1)
+#define CONSOLE_STREAM_ALL (CONSOLE_STREAM_TEXT | CONSOLE_STREAM_DUMP)
+
+typedef void (*console_sink_write_fn_t)(
+    void* context,
+    const char* data,
+    size_t length);
+
+typedef void (*console_sink_flush_fn_t)(
+    void* context);
+
+struct console_sink {
+    const char* name;
+    console_sink_write_fn_t write;
+    console_sink_flush_fn_t flush;
+    void* context;
+    uint32_t streams;
+};
+
+void console_initialize();
+
+struct console_sink* console_sink_register(
+    const char* name,
+    console_sink_write_fn_t write,
+    console_sink_flush_fn_t flush,
+    void* context,
+    uint32_t streams);
+
+struct console_sink* console_sink_find(
+    const char* name,
+    size_t name_length);
+
+void console_select_sinks(
+    uint32_t stream,
+    const char* list,
+    size_t list_length);
+
+int console_stream_has_sinks(
+    uint32_t stream);
+
+void console_write(
+    uint32_t stream,
+    const char* data,
+    size_t length);
+
 void console_writestring(
     const char* data);
 
-void console_set_serial_port(
-    int port);
+void console_flush();
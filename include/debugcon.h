@@ -0,0 +1,7 @@
+#define DEBUGCON_PORT 0xE9
+
+int debugcon_detect();
+
+void debugcon_write(
+    const char* data,
+    size_t length);
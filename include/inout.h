@@ -10,6 +10,11 @@ void outl(
     uint16_t port,
     uint32_t data);
 
+void outsb(
+    uint16_t port,
+    const char* data,
+    size_t length);
+
 uint8_t inb(
     uint16_t port);
 
@@ -0,0 +1,23 @@
+#define INTERRUPTS_IRQ_BASE 0x20
+#define INTERRUPTS_VECTORS 256
+
+#define INTERRUPTS_GDT_CODE_SELECTOR 0x08
+#define INTERRUPTS_GDT_DATA_SELECTOR 0x10
+
+typedef void (*interrupts_handler_t)();
+
+void interrupts_initialize();
+
+void interrupts_set_handler(
+    uint8_t vector,
+    interrupts_handler_t handler);
+
+void interrupts_unmask_irq(
+    uint8_t irq);
+
+void interrupts_mask_irq(
+    uint8_t irq);
+
+void interrupts_enable();
+
+void interrupts_disable();
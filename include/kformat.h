@@ -0,0 +1,15 @@
+// Supported conversions: %d %u %x %X %s %c %% and %B, which takes the bus,
+// device and function as three unsigned int and prints them as BB:DD:FF.
+// Flags '-' (left align) and '0' (zero pad), a width (or * to take it from the
+// arguments) and the l / ll length modifiers are accepted.
+size_t kformat(
+    char* buffer,
+    size_t buffer_length,
+    const char* format,
+    ...);
+
+size_t kformat_va(
+    char* buffer,
+    size_t buffer_length,
+    const char* format,
+    va_list args);
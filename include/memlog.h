@@ -0,0 +1,5 @@
+#define MEMLOG_SIZE (64 * 1024)
+
+void memlog_write(
+    const char* data,
+    size_t length);
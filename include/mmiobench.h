@@ -0,0 +1,30 @@
+#define MMIOBENCH_DEVICES_MAX 256
+#define MMIOBENCH_ROOT_PORTS_MAX 64
+#define MMIOBENCH_SAMPLES 256
+
+// A function is flagged when its median latency is this many times the lower
+// median of the other functions in its group, the same root port or the same
+// root bus. A PCIe root port usually has a single endpoint behind it, so most
+// root port groups have nothing to compare with and are not audited
+#define MMIOBENCH_OUTLIER_FACTOR 4
+#define MMIOBENCH_OUTLIER_MIN_FUNCTIONS 2
+
+// The group of the functions sitting directly on a root bus, the other groups
+// are the bus, device and function of a root port
+#define MMIOBENCH_ROOT_BUS(bus) (0x10000 | (bus))
+#define MMIOBENCH_IS_ROOT_BUS(group) (((group) & 0x10000) != 0)
+
+struct mmiobench_result {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint8_t bar_index;
+    uint32_t group;
+    uint64_t bar_base;
+    uint64_t bar_size;
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+};
+
+void mmiobench_run();
@@ -1,3 +1,9 @@
+typedef int (*pci_enumerate_fn_t)(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    void* context);
+
 uint16_t pci_config_read_word(
     uint8_t bus,
     uint8_t device,
@@ -10,6 +16,47 @@ uint32_t pci_config_read_long(
     uint8_t func,
     uint8_t offset);
 
+void pci_config_write_word(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t offset,
+    uint16_t data);
+
+void pci_config_write_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t offset,
+    uint32_t data);
+
+int pci_ecam_initialize();
+
+uint32_t pci_config_read_ext_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t offset);
+
+void pci_config_write_ext_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t offset,
+    uint32_t data);
+
+uint16_t pci_find_ext_capability(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t id);
+
+uint8_t pci_find_capability(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t id);
+
 uint16_t pci_get_device_id(
     uint8_t bus,
     uint8_t device,
@@ -50,6 +97,16 @@ void pci_print_dev_info(
     uint8_t device,
     uint8_t function);
 
+void pci_dump_config_space(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
+void pci_print_function(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
 unsigned pci_check_function(
     uint8_t bus,
     uint8_t device,
@@ -60,3 +117,7 @@ unsigned pci_check_device(
     uint8_t device);
 
 void pci_check_all_buses();
+
+int pci_enumerate(
+    pci_enumerate_fn_t callback,
+    void* context);
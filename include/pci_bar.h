@@ -0,0 +1,51 @@
+#define PCI_BAR_FLAG_IO (1 << 0)
+#define PCI_BAR_FLAG_64BIT (1 << 1)
+#define PCI_BAR_FLAG_PREFETCHABLE (1 << 2)
+
+#define PCI_EXT_CAP_ID_REBAR 0x0015
+#define PCI_BAR_FINDINGS_MAX 64
+
+struct pci_bar {
+    uint8_t index;
+    uint8_t flags;
+    uint64_t base;
+    uint64_t size;
+};
+
+unsigned pci_bar_count(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
+unsigned pci_bar_size(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t offset,
+    unsigned extended,
+    unsigned allow_64bit,
+    struct pci_bar* bar);
+
+unsigned pci_bar_probe(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint8_t index,
+    struct pci_bar* bar);
+
+size_t pci_bar_format_size(
+    uint64_t size,
+    char* buffer,
+    size_t buffer_length);
+
+void pci_bar_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
+void pci_bar_print_rebar_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
+void pci_bar_print_summary();
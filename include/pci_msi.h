@@ -0,0 +1,12 @@
+#define PCI_CAP_ID_MSI 0x05
+#define PCI_CAP_ID_MSIX 0x11
+
+void pci_msi_set_cpu_count(
+    unsigned cpus);
+
+void pci_msi_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
+
+void pci_msi_print_summary();
@@ -0,0 +1,6 @@
+#define PCI_EXT_CAP_ID_SRIOV 0x0010
+
+void pci_sriov_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function);
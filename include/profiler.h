@@ -0,0 +1,25 @@
+#define PROFILER_HISTOGRAM_BITS 12
+#define PROFILER_HISTOGRAM_SIZE (1 << PROFILER_HISTOGRAM_BITS)
+#define PROFILER_DEFAULT_HZ 1000
+#define PROFILER_TOP_FUNCTIONS 20
+#define PROFILER_TOP_ADDRESSES 10
+
+// Generated at build time from the symbols of the linked kernel, see
+// tools/gensymtab.sh, sorted by address
+struct profiler_symbol {
+    uint32_t address;
+    const char* name;
+};
+
+extern const struct profiler_symbol profiler_symbols[];
+extern const unsigned profiler_symbols_count;
+
+void profiler_start(
+    uint32_t hz);
+
+void profiler_stop();
+
+void profiler_sample(
+    uint32_t eip);
+
+void profiler_report();
@@ -28,3 +28,6 @@ void serial_write(
 void serial_writestring(
     int port,
     const char *data);
+
+void serial_flush(
+    int port);
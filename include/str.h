@@ -1,6 +1,15 @@
 size_t str_len(
     const char* str);
 
+int str_ncmp(
+    const char* str1,
+    const char* str2,
+    size_t length);
+
+uint64_t str_decstr_to_uint64(
+    const char* str,
+    size_t length);
+
 unsigned str_uint64_to_decstr_len(
     uint64_t number);
 
@@ -15,3 +24,17 @@ char* str_uint64_to_hexstr(
     uint8_t length,
     char* buffer,
     size_t buffer_length);
+
+void str_uint64_to_decstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    char* buffer);
+
+unsigned str_uint64_to_hexstr_len(
+    uint64_t number);
+
+void str_uint64_to_hexstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    unsigned uppercase,
+    char* buffer);
@@ -0,0 +1,166 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+#include "acpi.h"
+
+#define ACPI_RSDP_SIGNATURE "RSD PTR "
+#define ACPI_EBDA_SEGMENT_POINTER 0x40E
+#define ACPI_BIOS_AREA_START 0xE0000
+#define ACPI_BIOS_AREA_END 0x100000
+
+#define ACPI_MADT_ENTRIES_OFFSET 8
+#define ACPI_MADT_TYPE_LOCAL_APIC 0
+#define ACPI_MADT_TYPE_LOCAL_X2APIC 9
+#define ACPI_MADT_LOCAL_APIC_ENABLED (1 << 0)
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+const struct acpi_sdt_header* acpi_root_table = NULL;
+unsigned acpi_root_table_entry_size = 4;
+
+static uint8_t acpi_checksum(
+    const void* data,
+    size_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+
+    return sum;
+}
+
+static const struct acpi_rsdp* acpi_find_rsdp_in_range(
+    uintptr_t start,
+    uintptr_t end) {
+    for (uintptr_t address = start; address + 20 <= end; address += 16) {
+        const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)address;
+        if (str_ncmp(rsdp->signature, ACPI_RSDP_SIGNATURE, 8) == 0 &&
+            acpi_checksum(rsdp, 20) == 0) {
+            return rsdp;
+        }
+    }
+
+    return NULL;
+}
+
+// The RSDP is either in the first KiB of the EBDA or in the BIOS read-only
+// area between 0xE0000 and 0xFFFFF, always on a 16 byte boundary
+static const struct acpi_rsdp* acpi_find_rsdp() {
+    const struct acpi_rsdp* rsdp;
+    uintptr_t ebda_pointer = ACPI_EBDA_SEGMENT_POINTER;
+
+    // Hides the constant address from gcc, which otherwise considers any
+    // access to the first page out of bounds
+    asm ("" : "+r" (ebda_pointer));
+    uintptr_t ebda = (uintptr_t)(*(volatile uint16_t*)ebda_pointer) << 4;
+
+    if (ebda != 0 && (rsdp = acpi_find_rsdp_in_range(ebda, ebda + 1024)) != NULL) {
+        return rsdp;
+    }
+
+    return acpi_find_rsdp_in_range(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+}
+
+// Locates the XSDT, or the RSDT on ACPI 1.0 firmwares or when the XSDT is
+// above 4 GiB, returns 0 if the tables can't be found
+int acpi_initialize() {
+    const struct acpi_rsdp* rsdp = acpi_find_rsdp();
+
+    acpi_root_table = NULL;
+    if (rsdp == NULL) {
+        return 0;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address != 0 &&
+        rsdp->xsdt_address < 0x100000000ULL &&
+        acpi_checksum(rsdp, rsdp->length) == 0) {
+        acpi_root_table = (const struct acpi_sdt_header*)(uintptr_t)rsdp->xsdt_address;
+        acpi_root_table_entry_size = 8;
+    } else {
+        acpi_root_table = (const struct acpi_sdt_header*)(uintptr_t)rsdp->rsdt_address;
+        acpi_root_table_entry_size = 4;
+    }
+
+    if (acpi_checksum(acpi_root_table, acpi_root_table->length) != 0) {
+        acpi_root_table = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+const struct acpi_sdt_header* acpi_find_table(
+    const char* signature) {
+    if (acpi_root_table == NULL) {
+        return NULL;
+    }
+
+    const uint8_t* entries = (const uint8_t*)(acpi_root_table + 1);
+    unsigned count = (acpi_root_table->length - sizeof(struct acpi_sdt_header)) /
+        acpi_root_table_entry_size;
+
+    for (unsigned i = 0; i < count; i++) {
+        const uint8_t* entry = entries + i * acpi_root_table_entry_size;
+        uint64_t address = *(const uint32_t*)entry;
+        if (acpi_root_table_entry_size == 8) {
+            address |= (uint64_t)*(const uint32_t*)(entry + 4) << 32;
+        }
+
+        if (address == 0 || address >= 0x100000000ULL) {
+            continue;
+        }
+
+        const struct acpi_sdt_header* table = (const struct acpi_sdt_header*)(uintptr_t)address;
+        if (str_ncmp(table->signature, signature, 4) == 0 &&
+            acpi_checksum(table, table->length) == 0) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+// Counts the enabled processors listed in the MADT, both as local APIC and as
+// local x2APIC entries, returns 0 if the table is missing
+unsigned acpi_count_cpus() {
+    const struct acpi_sdt_header* madt = acpi_find_table("APIC");
+    unsigned cpus = 0;
+
+    if (madt == NULL) {
+        return 0;
+    }
+
+    const uint8_t* entry = (const uint8_t*)(madt + 1) + ACPI_MADT_ENTRIES_OFFSET;
+    const uint8_t* end = (const uint8_t*)madt + madt->length;
+
+    while (entry + 2 <= end && entry[1] >= 2 && entry + entry[1] <= end) {
+        uint32_t flags = 0;
+
+        if (entry[0] == ACPI_MADT_TYPE_LOCAL_APIC && entry[1] >= 8) {
+            flags = *(const uint32_t*)(entry + 4);
+        } else if (entry[0] == ACPI_MADT_TYPE_LOCAL_X2APIC && entry[1] >= 12) {
+            flags = *(const uint32_t*)(entry + 8);
+        }
+
+        if ((flags & ACPI_MADT_LOCAL_APIC_ENABLED) != 0) {
+            cpus++;
+        }
+
+        entry += entry[1];
+    }
+
+    return cpus;
+}
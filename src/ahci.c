@@ -0,0 +1,496 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+#include "pci.h"
+#include "ahci.h"
+
+#define AHCI_PCI_CLASS 0x01
+#define AHCI_PCI_SUBCLASS 0x06
+#define AHCI_PCI_PROG_IF 0x01
+#define AHCI_PCI_ABAR_OFFSET 0x24
+
+#define AHCI_HBA_GHC 0x04
+#define AHCI_HBA_PI 0x0C
+#define AHCI_HBA_CAP2 0x24
+#define AHCI_HBA_BOHC 0x28
+#define AHCI_HBA_GHC_AE (1U << 31)
+#define AHCI_HBA_CAP2_BOH (1 << 0)
+#define AHCI_HBA_BOHC_BOS (1 << 0)
+#define AHCI_HBA_BOHC_OOS (1 << 1)
+#define AHCI_HBA_BOHC_BB (1 << 4)
+#define AHCI_HBA_PORTS_MAX 32
+
+#define AHCI_PORT_BASE(port) (0x100 + (port) * 0x80)
+#define AHCI_PORT_CLB 0x00
+#define AHCI_PORT_CLBU 0x04
+#define AHCI_PORT_FB 0x08
+#define AHCI_PORT_FBU 0x0C
+#define AHCI_PORT_IS 0x10
+#define AHCI_PORT_IE 0x14
+#define AHCI_PORT_CMD 0x18
+#define AHCI_PORT_TFD 0x20
+#define AHCI_PORT_SIG 0x24
+#define AHCI_PORT_SSTS 0x28
+#define AHCI_PORT_SERR 0x30
+#define AHCI_PORT_CI 0x38
+
+#define AHCI_PORT_CMD_ST (1 << 0)
+#define AHCI_PORT_CMD_FRE (1 << 4)
+#define AHCI_PORT_CMD_FR (1 << 14)
+#define AHCI_PORT_CMD_CR (1 << 15)
+#define AHCI_PORT_IS_TFES (1 << 30)
+#define AHCI_PORT_TFD_ERR (1 << 0)
+#define AHCI_PORT_TFD_DRQ (1 << 3)
+#define AHCI_PORT_TFD_BSY (1 << 7)
+#define AHCI_PORT_SSTS_DET_PRESENT 3
+#define AHCI_PORT_SIG_ATA 0x00000101
+
+#define AHCI_FIS_TYPE_REG_H2D 0x27
+#define AHCI_ATA_CMD_READ_DMA_EXT 0x25
+#define AHCI_ATA_CMD_WRITE_DMA_EXT 0x35
+
+#define AHCI_COMMAND_HEADER_WRITE (1 << 6)
+#define AHCI_PRD_BYTES_MAX (4 * 1024 * 1024)
+#define AHCI_TIMEOUT_SPINS 10000000
+
+// Data is accumulated here and written out with a single DMA transfer when
+// full or when the sink is flushed
+#define AHCI_STAGING_SIZE (256 * 1024)
+
+struct ahci_command_header {
+    uint16_t flags;
+    uint16_t prdtl;
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed));
+
+struct ahci_prd_entry {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;
+} __attribute__((packed));
+
+struct ahci_fis_reg_h2d {
+    uint8_t fis_type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t feature_low;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+    uint8_t reserved[4];
+} __attribute__((packed));
+
+struct ahci_command_table {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    struct ahci_prd_entry prdt[1];
+} __attribute__((packed));
+
+// Paging is disabled so the physical address of these buffers is their
+// address, the HBA can access them directly
+struct ahci_command_header ahci_command_list[32] __attribute__((aligned(1024)));
+uint8_t ahci_received_fis[256] __attribute__((aligned(256)));
+struct ahci_command_table ahci_command_table __attribute__((aligned(128)));
+char ahci_staging[AHCI_STAGING_SIZE] __attribute__((aligned(4096)));
+char ahci_sector[AHCI_SECTOR_SIZE] __attribute__((aligned(4096)));
+
+volatile uint8_t* ahci_abar = NULL;
+int ahci_port = -1;
+size_t ahci_staging_length = 0;
+uint32_t ahci_dump_lba = AHCI_DUMP_LBA_START + 1;
+uint32_t ahci_dump_truncated = 0;
+
+static inline uint32_t ahci_read(
+    uint32_t offset) {
+    return *(volatile uint32_t*)(ahci_abar + offset);
+}
+
+static inline void ahci_write(
+    uint32_t offset,
+    uint32_t value) {
+    *(volatile uint32_t*)(ahci_abar + offset) = value;
+}
+
+static int ahci_wait_clear(
+    uint32_t offset,
+    uint32_t mask) {
+    for (unsigned spins = 0; spins < AHCI_TIMEOUT_SPINS; spins++) {
+        if ((ahci_read(offset) & mask) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int ahci_port_stop(
+    int port) {
+    uint32_t base = AHCI_PORT_BASE(port);
+
+    ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) & ~AHCI_PORT_CMD_ST);
+    if (!ahci_wait_clear(base + AHCI_PORT_CMD, AHCI_PORT_CMD_CR)) {
+        return 0;
+    }
+
+    ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) & ~AHCI_PORT_CMD_FRE);
+    return ahci_wait_clear(base + AHCI_PORT_CMD, AHCI_PORT_CMD_FR);
+}
+
+// Points the port to the kernel command list and received FIS area, the
+// previous owner (the BIOS) is stopped first
+static int ahci_port_start(
+    int port) {
+    uint32_t base = AHCI_PORT_BASE(port);
+
+    if (!ahci_port_stop(port)) {
+        return 0;
+    }
+
+    ahci_write(base + AHCI_PORT_CLB, (uint32_t)(uintptr_t)ahci_command_list);
+    ahci_write(base + AHCI_PORT_CLBU, 0);
+    ahci_write(base + AHCI_PORT_FB, (uint32_t)(uintptr_t)ahci_received_fis);
+    ahci_write(base + AHCI_PORT_FBU, 0);
+    ahci_write(base + AHCI_PORT_SERR, 0xFFFFFFFF);
+    ahci_write(base + AHCI_PORT_IS, 0xFFFFFFFF);
+    ahci_write(base + AHCI_PORT_IE, 0);
+
+    ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) | AHCI_PORT_CMD_FRE);
+    if (!ahci_wait_clear(base + AHCI_PORT_TFD, AHCI_PORT_TFD_BSY | AHCI_PORT_TFD_DRQ)) {
+        return 0;
+    }
+    ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) | AHCI_PORT_CMD_ST);
+
+    return 1;
+}
+
+// Issues a polled READ / WRITE DMA EXT through command slot 0, the buffer must
+// be physically contiguous and word aligned
+static int ahci_port_transfer(
+    int port,
+    uint64_t lba,
+    uint16_t sectors,
+    void* buffer,
+    int write) {
+    uint32_t base = AHCI_PORT_BASE(port);
+    uint32_t bytes = (uint32_t)sectors * AHCI_SECTOR_SIZE;
+    struct ahci_command_header* header = &ahci_command_list[0];
+    struct ahci_fis_reg_h2d* fis = (struct ahci_fis_reg_h2d*)ahci_command_table.cfis;
+
+    if (bytes == 0 || bytes > AHCI_PRD_BYTES_MAX) {
+        return 0;
+    }
+
+    header->flags = (sizeof(struct ahci_fis_reg_h2d) / 4) |
+        (write ? AHCI_COMMAND_HEADER_WRITE : 0);
+    header->prdtl = 1;
+    header->prdbc = 0;
+    header->ctba = (uint32_t)(uintptr_t)&ahci_command_table;
+    header->ctbau = 0;
+
+    ahci_command_table.prdt[0].dba = (uint32_t)(uintptr_t)buffer;
+    ahci_command_table.prdt[0].dbau = 0;
+    ahci_command_table.prdt[0].reserved = 0;
+    ahci_command_table.prdt[0].dbc = bytes - 1;
+
+    fis->fis_type = AHCI_FIS_TYPE_REG_H2D;
+    fis->flags = 0x80;
+    fis->command = write ? AHCI_ATA_CMD_WRITE_DMA_EXT : AHCI_ATA_CMD_READ_DMA_EXT;
+    fis->feature_low = 0;
+    fis->lba0 = (uint8_t)lba;
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->device = 1 << 6;
+    fis->lba3 = (uint8_t)(lba >> 24);
+    fis->lba4 = (uint8_t)(lba >> 32);
+    fis->lba5 = (uint8_t)(lba >> 40);
+    fis->feature_high = 0;
+    fis->count_low = (uint8_t)sectors;
+    fis->count_high = (uint8_t)(sectors >> 8);
+    fis->icc = 0;
+    fis->control = 0;
+
+    if (!ahci_wait_clear(base + AHCI_PORT_TFD, AHCI_PORT_TFD_BSY | AHCI_PORT_TFD_DRQ)) {
+        return 0;
+    }
+
+    // Make sure the command table is in memory before the HBA fetches it
+    asm volatile ("" : : : "memory");
+
+    ahci_write(base + AHCI_PORT_IS, 0xFFFFFFFF);
+    ahci_write(base + AHCI_PORT_CI, 1);
+
+    for (unsigned spins = 0; spins < AHCI_TIMEOUT_SPINS; spins++) {
+        if ((ahci_read(base + AHCI_PORT_IS) & AHCI_PORT_IS_TFES) != 0) {
+            return 0;
+        }
+
+        if ((ahci_read(base + AHCI_PORT_CI) & 1) == 0) {
+            asm volatile ("" : : : "memory");
+            return (ahci_read(base + AHCI_PORT_TFD) & AHCI_PORT_TFD_ERR) == 0;
+        }
+    }
+
+    return 0;
+}
+
+struct ahci_port_state {
+    uint32_t clb;
+    uint32_t clbu;
+    uint32_t fb;
+    uint32_t fbu;
+    uint32_t ie;
+    uint32_t cmd;
+};
+
+static void ahci_port_save(
+    int port,
+    struct ahci_port_state* state) {
+    uint32_t base = AHCI_PORT_BASE(port);
+
+    state->clb = ahci_read(base + AHCI_PORT_CLB);
+    state->clbu = ahci_read(base + AHCI_PORT_CLBU);
+    state->fb = ahci_read(base + AHCI_PORT_FB);
+    state->fbu = ahci_read(base + AHCI_PORT_FBU);
+    state->ie = ahci_read(base + AHCI_PORT_IE);
+    state->cmd = ahci_read(base + AHCI_PORT_CMD);
+}
+
+// Hands the port back to its previous owner: the command engine is stopped,
+// the command list and received FIS area are pointed back to the previous
+// buffers and the engine is restarted if it was running. The errors and
+// interrupts cleared by ahci_port_start can't be restored.
+static void ahci_port_restore(
+    int port,
+    const struct ahci_port_state* state) {
+    uint32_t base = AHCI_PORT_BASE(port);
+
+    if (!ahci_port_stop(port)) {
+        return;
+    }
+
+    ahci_write(base + AHCI_PORT_CLB, state->clb);
+    ahci_write(base + AHCI_PORT_CLBU, state->clbu);
+    ahci_write(base + AHCI_PORT_FB, state->fb);
+    ahci_write(base + AHCI_PORT_FBU, state->fbu);
+    ahci_write(base + AHCI_PORT_IE, state->ie);
+
+    if ((state->cmd & AHCI_PORT_CMD_FRE) != 0) {
+        ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) | AHCI_PORT_CMD_FRE);
+    }
+
+    if ((state->cmd & AHCI_PORT_CMD_ST) != 0) {
+        ahci_write(base + AHCI_PORT_CMD, ahci_read(base + AHCI_PORT_CMD) | AHCI_PORT_CMD_ST);
+    }
+}
+
+// Only a disk carrying the marker written by the Makefile is used. Probing an
+// ATA port takes it over to read the marker, the ports without it are handed
+// back with ahci_port_restore.
+static int ahci_port_has_dump_area(
+    int port) {
+    uint32_t base = AHCI_PORT_BASE(port);
+    struct ahci_port_state state;
+
+    if ((ahci_read(base + AHCI_PORT_SSTS) & 0x0F) != AHCI_PORT_SSTS_DET_PRESENT ||
+        ahci_read(base + AHCI_PORT_SIG) != AHCI_PORT_SIG_ATA) {
+        return 0;
+    }
+
+    ahci_port_save(port, &state);
+
+    if (!ahci_port_start(port) ||
+        !ahci_port_transfer(port, AHCI_DUMP_LBA_START, 1, ahci_sector, 0) ||
+        str_ncmp(ahci_sector, AHCI_DUMP_MAGIC, sizeof(((struct ahci_dump_header*)0)->magic)) != 0) {
+        ahci_port_restore(port, &state);
+        return 0;
+    }
+
+    return 1;
+}
+
+// BIOS/OS handoff: firmware supporting it may still drive the HBA from SMM, the
+// ownership is requested and the ports are only touched once the BIOS has
+// released it. There is no timer, the waits are bounded by the number of
+// register reads, and the BIOS busy flag is waited on once it's raised as it
+// still has to finish the outstanding commands.
+static int ahci_take_ownership() {
+    if ((ahci_read(AHCI_HBA_CAP2) & AHCI_HBA_CAP2_BOH) == 0) {
+        return 1;
+    }
+
+    ahci_write(AHCI_HBA_BOHC, ahci_read(AHCI_HBA_BOHC) | AHCI_HBA_BOHC_OOS);
+
+    if (!ahci_wait_clear(AHCI_HBA_BOHC, AHCI_HBA_BOHC_BOS)) {
+        return 0;
+    }
+
+    return ahci_wait_clear(AHCI_HBA_BOHC, AHCI_HBA_BOHC_BB);
+}
+
+static int ahci_probe_controller(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    void* context) {
+    (void)context;
+
+    if (pci_get_class(bus, device, function) != AHCI_PCI_CLASS ||
+        pci_get_subclass(bus, device, function) != AHCI_PCI_SUBCLASS ||
+        pci_get_prog_if(bus, device, function) != AHCI_PCI_PROG_IF) {
+        return 0;
+    }
+
+    uint32_t abar = pci_config_read_long(bus, device, function, AHCI_PCI_ABAR_OFFSET);
+    if ((abar & 1) != 0 || (abar & ~0xFU) == 0) {
+        return 0;
+    }
+
+    // Enable the memory space decoding and the bus mastering for the DMA
+    uint16_t command = pci_config_read_word(bus, device, function, 0x04);
+    pci_config_write_word(bus, device, function, 0x04, command | (1 << 1) | (1 << 2));
+
+    ahci_abar = (volatile uint8_t*)(uintptr_t)(abar & ~0xFU);
+
+    uint32_t ghc = ahci_read(AHCI_HBA_GHC);
+    if (ahci_take_ownership()) {
+        ahci_write(AHCI_HBA_GHC, ghc | AHCI_HBA_GHC_AE);
+
+        uint32_t ports_implemented = ahci_read(AHCI_HBA_PI);
+        for (int port = 0; port < AHCI_HBA_PORTS_MAX; port++) {
+            if ((ports_implemented & (1U << port)) != 0 && ahci_port_has_dump_area(port)) {
+                ahci_port = port;
+                return 1;
+            }
+        }
+
+        // The ports have been handed back already, the ownership of the HBA
+        // can't be returned to the BIOS
+        ahci_write(AHCI_HBA_GHC, ghc);
+    }
+
+    ahci_abar = NULL;
+    pci_config_write_word(bus, device, function, 0x04, command);
+    return 0;
+}
+
+// Looks for an AHCI controller with a disk carrying the dump area, returns the
+// port number or -1 if none is found
+int ahci_dump_initialize() {
+    ahci_port = -1;
+    ahci_staging_length = 0;
+    ahci_dump_lba = AHCI_DUMP_LBA_START + 1;
+    ahci_dump_truncated = 0;
+
+    pci_enumerate(ahci_probe_controller, NULL);
+
+    return ahci_port;
+}
+
+// Writes the full sectors of the staging buffer plus, if partial is set, the
+// last partially filled sector, which is kept in the staging buffer so the
+// following data is appended to it
+static void ahci_dump_write_staging(
+    int partial) {
+    uint32_t sectors = ahci_staging_length / AHCI_SECTOR_SIZE;
+    uint32_t tail = ahci_staging_length % AHCI_SECTOR_SIZE;
+    uint32_t sectors_to_write = sectors + (partial && tail > 0 ? 1 : 0);
+
+    if (sectors_to_write == 0) {
+        return;
+    }
+
+    if (ahci_dump_lba + sectors_to_write > AHCI_DUMP_LBA_START + AHCI_DUMP_SECTORS) {
+        ahci_dump_truncated = 1;
+        ahci_staging_length = 0;
+        return;
+    }
+
+    if (tail > 0 && partial) {
+        for (uint32_t i = ahci_staging_length; i < sectors_to_write * AHCI_SECTOR_SIZE; i++) {
+            ahci_staging[i] = 0;
+        }
+    }
+
+    if (!ahci_port_transfer(ahci_port, ahci_dump_lba, sectors_to_write, ahci_staging, 1)) {
+        ahci_dump_truncated = 1;
+    }
+
+    if (tail > 0) {
+        char* last = ahci_staging + sectors * AHCI_SECTOR_SIZE;
+        for (uint32_t i = 0; i < tail; i++) {
+            ahci_staging[i] = last[i];
+        }
+    }
+
+    ahci_dump_lba += sectors;
+    ahci_staging_length = tail;
+}
+
+void ahci_dump_write(
+    const char* data,
+    size_t length) {
+    if (ahci_port < 0) {
+        return;
+    }
+
+    while (length > 0) {
+        size_t chunk = AHCI_STAGING_SIZE - ahci_staging_length;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        char* destination = ahci_staging + ahci_staging_length;
+        for (size_t i = 0; i < chunk; i++) {
+            destination[i] = data[i];
+        }
+
+        ahci_staging_length += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (ahci_staging_length == AHCI_STAGING_SIZE) {
+            ahci_dump_write_staging(0);
+        }
+    }
+}
+
+// Writes out whatever is pending and updates the header with the length of
+// the data, the header is what tells the host how much of the area to read
+void ahci_dump_flush() {
+    if (ahci_port < 0) {
+        return;
+    }
+
+    ahci_dump_write_staging(1);
+
+    struct ahci_dump_header* header = (struct ahci_dump_header*)ahci_sector;
+    for (unsigned i = 0; i < AHCI_SECTOR_SIZE; i++) {
+        ahci_sector[i] = 0;
+    }
+
+    for (unsigned i = 0; i < sizeof(header->magic); i++) {
+        header->magic[i] = AHCI_DUMP_MAGIC[i];
+    }
+    header->version = AHCI_DUMP_VERSION;
+    header->truncated = ahci_dump_truncated;
+    header->length =
+        (uint64_t)(ahci_dump_lba - (AHCI_DUMP_LBA_START + 1)) * AHCI_SECTOR_SIZE +
+        ahci_staging_length;
+
+    ahci_port_transfer(ahci_port, AHCI_DUMP_LBA_START, 1, ahci_sector, 1);
+}
@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+#include "cmdline.h"
+
+const char* cmdline = "";
+
+void cmdline_initialize(
+    const char* data) {
+    cmdline = data != NULL ? data : "";
+}
+
+// Looks for a "key" or "key=value" token in the space separated command line
+// passed by the bootloader, returns a pointer to the value (an empty string if
+// the option has no value) or NULL if the option is missing
+const char* cmdline_get_option(
+    const char* key,
+    size_t* value_length) {
+    size_t key_length = str_len(key);
+    const char* token = cmdline;
+
+    while (*token) {
+        while (*token == ' ') {
+            token++;
+        }
+
+        size_t token_length = 0;
+        while (token[token_length] && token[token_length] != ' ') {
+            token_length++;
+        }
+
+        if (token_length >= key_length && str_ncmp(token, key, key_length) == 0) {
+            if (token_length == key_length) {
+                *value_length = 0;
+                return token + token_length;
+            }
+
+            if (token[key_length] == '=') {
+                *value_length = token_length - key_length - 1;
+                return token + key_length + 1;
+            }
+        }
+
+        token += token_length;
+    }
+
+    return NULL;
+}
+
+int cmdline_has_option(
+    const char* key) {
+    size_t value_length;
+    return cmdline_get_option(key, &value_length) != NULL;
+}
@@ -29,18 +29,169 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "str.h"
 #include "serial.h"
 #include "terminal.h"
+#include "debugcon.h"
+#include "memlog.h"
+#include "console.h"
 
-int console_serial_port = 0;
+struct console_sink console_sinks[CONSOLE_SINKS_MAX];
+unsigned console_sinks_count = 0;
+
+static void console_sink_vga_write(
+    void* context,
+    const char* data,
+    size_t length) {
+    (void)context;
+    terminal_write(data, length);
+}
+
+static void console_sink_uart_write(
+    void* context,
+    const char* data,
+    size_t length) {
+    serial_write((int)(uintptr_t)context, data, length);
+}
+
+static void console_sink_uart_flush(
+    void* context) {
+    serial_flush((int)(uintptr_t)context);
+}
+
+static void console_sink_debugcon_write(
+    void* context,
+    const char* data,
+    size_t length) {
+    (void)context;
+    debugcon_write(data, length);
+}
+
+static void console_sink_memlog_write(
+    void* context,
+    const char* data,
+    size_t length) {
+    (void)context;
+    memlog_write(data, length);
+}
+
+// Registers the built-in sinks, the UARTs start unsubscribed as they have to be
+// enabled first and the selection is up to the kernel
+void console_initialize() {
+    console_sinks_count = 0;
+
+    console_sink_register(
+        "vga", console_sink_vga_write, NULL, NULL, CONSOLE_STREAM_TEXT);
+    console_sink_register(
+        "uart_a", console_sink_uart_write, console_sink_uart_flush,
+        (void*)(uintptr_t)SERIAL_PORT_A, 0);
+    console_sink_register(
+        "uart_b", console_sink_uart_write, console_sink_uart_flush,
+        (void*)(uintptr_t)SERIAL_PORT_B, 0);
+
+    if (debugcon_detect()) {
+        console_sink_register(
+            "debugcon", console_sink_debugcon_write, NULL, NULL, 0);
+    }
+
+    console_sink_register(
+        "memlog", console_sink_memlog_write, NULL, NULL, CONSOLE_STREAM_ALL);
+}
+
+struct console_sink* console_sink_register(
+    const char* name,
+    console_sink_write_fn_t write,
+    console_sink_flush_fn_t flush,
+    void* context,
+    uint32_t streams) {
+    if (console_sinks_count == CONSOLE_SINKS_MAX) {
+        return NULL;
+    }
+
+    struct console_sink* sink = &console_sinks[console_sinks_count++];
+    sink->name = name;
+    sink->write = write;
+    sink->flush = flush;
+    sink->context = context;
+    sink->streams = streams;
+
+    return sink;
+}
+
+struct console_sink* console_sink_find(
+    const char* name,
+    size_t name_length) {
+    for (unsigned i = 0; i < console_sinks_count; i++) {
+        struct console_sink* sink = &console_sinks[i];
+        if (str_len(sink->name) == name_length &&
+            str_ncmp(sink->name, name, name_length) == 0) {
+            return sink;
+        }
+    }
+
+    return NULL;
+}
+
+// Subscribes to the stream only the sinks in the comma separated list, unknown
+// names are ignored
+void console_select_sinks(
+    uint32_t stream,
+    const char* list,
+    size_t list_length) {
+    for (unsigned i = 0; i < console_sinks_count; i++) {
+        console_sinks[i].streams &= ~stream;
+    }
+
+    size_t start = 0;
+    while (start < list_length) {
+        size_t end = start;
+        while (end < list_length && list[end] != ',') {
+            end++;
+        }
+
+        struct console_sink* sink = console_sink_find(list + start, end - start);
+        if (sink != NULL) {
+            sink->streams |= stream;
+        }
+
+        start = end + 1;
+    }
+}
+
+// Lets the producers of bulk data skip formatting it when nobody listens
+int console_stream_has_sinks(
+    uint32_t stream) {
+    for (unsigned i = 0; i < console_sinks_count; i++) {
+        if ((console_sinks[i].streams & stream) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void console_write(
+    uint32_t stream,
+    const char* data,
+    size_t length) {
+    for (unsigned i = 0; i < console_sinks_count; i++) {
+        struct console_sink* sink = &console_sinks[i];
+        if ((sink->streams & stream) != 0) {
+            sink->write(sink->context, data, length);
+        }
+    }
+}
 
 void console_writestring(
     const char* data) {
-    terminal_writestring(data);
-    serial_writestring(console_serial_port, data);
+    console_write(CONSOLE_STREAM_TEXT, data, str_len(data));
 }
 
-void console_set_serial_port(
-    int port) {
-    console_serial_port = port;
+void console_flush() {
+    for (unsigned i = 0; i < console_sinks_count; i++) {
+        struct console_sink* sink = &console_sinks[i];
+        if (sink->streams != 0 && sink->flush != NULL) {
+            sink->flush(sink->context);
+        }
+    }
 }
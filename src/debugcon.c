@@ -0,0 +1,19 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inout.h"
+#include "debugcon.h"
+
+// QEMU and Bochs return the port number when reading from the debug console
+// port, real hardware normally returns 0xFF
+int debugcon_detect() {
+    return inb(DEBUGCON_PORT) == DEBUGCON_PORT;
+}
+
+// The debug console doesn't have any status register to poll, the whole buffer
+// is pushed out with a single rep outsb
+void debugcon_write(
+    const char* data,
+    size_t length) {
+    outsb(DEBUGCON_PORT, data, length);
+}
@@ -26,9 +26,10 @@
 // handle the serial port from
 // https://github.com/stevej/osdev/blob/master/kernel/devices/serial.c
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include "stdint.h"
+#include "inout.h"
 
 void outb(
     uint16_t port,
@@ -48,6 +49,13 @@ void outl(
     asm volatile ("outl %1, %0" : : "dN" (port), "a" (data));
 }
 
+void outsb(
+    uint16_t port,
+    const char* data,
+    size_t length) {
+    asm volatile ("rep outsb" : "+S" (data), "+c" (length) : "d" (port) : "memory");
+}
+
 uint8_t inb(
     uint16_t port) {
     uint8_t ret;
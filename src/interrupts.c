@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inout.h"
+#include "interrupts.h"
+
+#define PIC_MASTER_COMMAND 0x20
+#define PIC_MASTER_DATA 0x21
+#define PIC_SLAVE_COMMAND 0xA0
+#define PIC_SLAVE_DATA 0xA1
+
+#define IDT_INTERRUPT_GATE 0x8E
+
+struct interrupts_descriptor_pointer {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+struct interrupts_idt_entry {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attributes;
+    uint16_t offset_high;
+} __attribute__((packed));
+
+// Flat 4 GiB code and data segments, the GDT set up by the bootloader can't be
+// relied on once the interrupts are enabled
+static const uint64_t interrupts_gdt[] __attribute__((aligned(8))) = {
+    0x0000000000000000ULL,
+    0x00CF9A000000FFFFULL,
+    0x00CF92000000FFFFULL,
+};
+
+struct interrupts_idt_entry interrupts_idt[INTERRUPTS_VECTORS] __attribute__((aligned(8)));
+
+void isr_exception();
+void isr_irq_master();
+void isr_irq_slave();
+
+static inline void interrupts_io_wait() {
+    outb(0x80, 0);
+}
+
+static void interrupts_load_gdt() {
+    struct interrupts_descriptor_pointer gdtr = {
+        .limit = sizeof(interrupts_gdt) - 1,
+        .base = (uint32_t)(uintptr_t)interrupts_gdt,
+    };
+
+    asm volatile (
+        "lgdt %0\n"
+        "ljmp %1, $1f\n"
+        "1:\n"
+        "mov %2, %%ax\n"
+        "mov %%ax, %%ds\n"
+        "mov %%ax, %%es\n"
+        "mov %%ax, %%fs\n"
+        "mov %%ax, %%gs\n"
+        "mov %%ax, %%ss\n"
+        :
+        : "m" (gdtr), "i" (INTERRUPTS_GDT_CODE_SELECTOR), "i" (INTERRUPTS_GDT_DATA_SELECTOR)
+        : "eax", "memory");
+}
+
+// Moves the IRQs of the two 8259 PICs after the CPU exceptions, starting at
+// INTERRUPTS_IRQ_BASE, and masks all of them
+static void interrupts_remap_pic() {
+    outb(PIC_MASTER_COMMAND, 0x11);
+    interrupts_io_wait();
+    outb(PIC_SLAVE_COMMAND, 0x11);
+    interrupts_io_wait();
+    outb(PIC_MASTER_DATA, INTERRUPTS_IRQ_BASE);
+    interrupts_io_wait();
+    outb(PIC_SLAVE_DATA, INTERRUPTS_IRQ_BASE + 8);
+    interrupts_io_wait();
+    outb(PIC_MASTER_DATA, 1 << 2);
+    interrupts_io_wait();
+    outb(PIC_SLAVE_DATA, 2);
+    interrupts_io_wait();
+    outb(PIC_MASTER_DATA, 0x01);
+    interrupts_io_wait();
+    outb(PIC_SLAVE_DATA, 0x01);
+    interrupts_io_wait();
+
+    outb(PIC_MASTER_DATA, 0xFF & ~(1 << 2));
+    outb(PIC_SLAVE_DATA, 0xFF);
+}
+
+void interrupts_set_handler(
+    uint8_t vector,
+    interrupts_handler_t handler) {
+    uint32_t offset = (uint32_t)(uintptr_t)handler;
+    struct interrupts_idt_entry* entry = &interrupts_idt[vector];
+
+    entry->offset_low = offset & 0xFFFF;
+    entry->selector = INTERRUPTS_GDT_CODE_SELECTOR;
+    entry->zero = 0;
+    entry->type_attributes = IDT_INTERRUPT_GATE;
+    entry->offset_high = offset >> 16;
+}
+
+// Loads the kernel GDT and an IDT where the exceptions halt the machine and
+// the IRQs are just acknowledged, all the IRQs start masked
+void interrupts_initialize() {
+    interrupts_disable();
+    interrupts_load_gdt();
+
+    for (unsigned vector = 0; vector < INTERRUPTS_VECTORS; vector++) {
+        interrupts_handler_t handler = isr_exception;
+        if (vector >= INTERRUPTS_IRQ_BASE && vector < INTERRUPTS_IRQ_BASE + 8) {
+            handler = isr_irq_master;
+        } else if (vector >= INTERRUPTS_IRQ_BASE + 8 && vector < INTERRUPTS_IRQ_BASE + 16) {
+            handler = isr_irq_slave;
+        }
+
+        interrupts_set_handler(vector, handler);
+    }
+
+    struct interrupts_descriptor_pointer idtr = {
+        .limit = sizeof(interrupts_idt) - 1,
+        .base = (uint32_t)(uintptr_t)interrupts_idt,
+    };
+    asm volatile ("lidt %0" : : "m" (idtr) : "memory");
+
+    interrupts_remap_pic();
+}
+
+void interrupts_unmask_irq(
+    uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void interrupts_mask_irq(
+    uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+void interrupts_enable() {
+    asm volatile ("sti" : : : "memory");
+}
+
+void interrupts_disable() {
+    asm volatile ("cli" : : : "memory");
+}
@@ -26,36 +26,167 @@
 // handle the serial port from
 // https://github.com/stevej/osdev/blob/master/kernel/devices/serial.c
 
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "inout.h"
 #include "str.h"
+#include "multiboot.h"
+#include "cmdline.h"
 #include "terminal.h"
 #include "serial.h"
 #include "console.h"
+#include "kformat.h"
+#include "acpi.h"
 #include "pci.h"
+#include "pci_bar.h"
+#include "pci_msi.h"
+#include "ahci.h"
+#include "mmiobench.h"
+#include "interrupts.h"
+#include "profiler.h"
 
-#define KERNEL_CONSOLE_SERIAL_PORT SERIAL_PORT_A
+// Sinks used when the command line doesn't carry console= or dump=, the
+// configuration space dumps go through the debug console port when running
+// under QEMU as it's way faster than the emulated UART, and are kept off the
+// UART and the memory ring otherwise as they would take minutes at 115200 baud
+// and push the scan results out of the ring. The ahci sink is only registered
+// if a disk with the dump area has been found.
+#define KERNEL_CONSOLE_TEXT_SINKS "vga,uart_a,memlog,ahci"
+#define KERNEL_CONSOLE_DUMP_SINKS "ahci"
+#define KERNEL_CONSOLE_DUMP_SINKS_DEBUGCON "debugcon,ahci"
+
+int kernel_ahci_port = -1;
+
+static void kernel_console_sink_ahci_write(
+    void* context,
+    const char* data,
+    size_t length) {
+    (void)context;
+    ahci_dump_write(data, length);
+}
+
+static void kernel_console_sink_ahci_flush(
+    void* context) {
+    (void)context;
+    ahci_dump_flush();
+}
+
+void kernel_cmdline_initialize(
+    uint32_t multiboot_magic,
+    struct multiboot_info* multiboot_info) {
+    if (multiboot_magic == MULTIBOOT_BOOTLOADER_MAGIC &&
+        (multiboot_info->flags & MULTIBOOT_INFO_CMDLINE) != 0) {
+        cmdline_initialize((const char*)(uintptr_t)multiboot_info->cmdline);
+    } else {
+        cmdline_initialize(NULL);
+    }
+}
+
+void kernel_console_select_sinks(
+    uint32_t stream,
+    const char* option,
+    const char* default_list) {
+    size_t list_length;
+    const char* list = cmdline_get_option(option, &list_length);
+
+    if (list == NULL) {
+        list = default_list;
+        list_length = str_len(default_list);
+    }
+
+    console_select_sinks(stream, list, list_length);
+}
 
 void kernel_serial_initialize() {
-	serial_enable(KERNEL_CONSOLE_SERIAL_PORT);
-    console_set_serial_port(KERNEL_CONSOLE_SERIAL_PORT);
+    struct console_sink* sink;
+
+    if ((sink = console_sink_find("uart_a", 6)) != NULL && sink->streams != 0) {
+        serial_enable(SERIAL_PORT_A);
+    }
+
+    if ((sink = console_sink_find("uart_b", 6)) != NULL && sink->streams != 0) {
+        serial_enable(SERIAL_PORT_B);
+    }
+}
+
+void kernel_console_initialize() {
+    console_initialize();
+
+    if (!cmdline_has_option("noahci") &&
+        (kernel_ahci_port = ahci_dump_initialize()) >= 0) {
+        console_sink_register(
+            "ahci", kernel_console_sink_ahci_write, kernel_console_sink_ahci_flush, NULL, 0);
+    }
+
+    kernel_console_select_sinks(
+        CONSOLE_STREAM_TEXT,
+        "console",
+        KERNEL_CONSOLE_TEXT_SINKS);
+    kernel_console_select_sinks(
+        CONSOLE_STREAM_DUMP,
+        "dump",
+        console_sink_find("debugcon", 8) != NULL
+            ? KERNEL_CONSOLE_DUMP_SINKS_DEBUGCON
+            : KERNEL_CONSOLE_DUMP_SINKS);
 }
  
 void kernel_terminal_initialize()  {
     terminal_initialize();
 }
 
-void kernel_main() {
+void kernel_main(
+    uint32_t multiboot_magic,
+    struct multiboot_info* multiboot_info) {
 	kernel_terminal_initialize();
+    kernel_cmdline_initialize(multiboot_magic, multiboot_info);
 
-    terminal_writestring("INITIALIZING SERIAL PORT 0");
+    terminal_writestring("INITIALIZING CONSOLE\n");
+    kernel_console_initialize();
 	kernel_serial_initialize();
+
+    if (kernel_ahci_port >= 0) {
+        char line[64];
+        size_t length = kformat(
+            line, sizeof(line), "AHCI DUMP AREA FOUND ON PORT %d\n", kernel_ahci_port);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
  
+    if (!acpi_initialize()) {
+        console_writestring("ACPI TABLES NOT FOUND\n");
+    }
+
+    if (!pci_ecam_initialize()) {
+        console_writestring("PCI EXTENDED CONFIGURATION SPACE NOT AVAILABLE\n");
+    }
+
+    // Without a MADT the vector audit assumes a single CPU
+    pci_msi_set_cpu_count(acpi_count_cpus());
+
+    size_t profile_hz_length;
+    const char* profile_hz = cmdline_get_option("profile", &profile_hz_length);
+    if (profile_hz != NULL) {
+        interrupts_initialize();
+        profiler_start((uint32_t)str_decstr_to_uint64(profile_hz, profile_hz_length));
+    }
+
 	console_writestring("SCANNING PCI BUS...\n");
 
     pci_check_all_buses();
+    pci_bar_print_summary();
+    pci_msi_print_summary();
     
 	console_writestring("SCAN COMPLETED\n");
+
+    if (cmdline_has_option("mmiobench")) {
+        mmiobench_run();
+    }
+
+    if (profile_hz != NULL) {
+        profiler_stop();
+        profiler_report();
+    }
+
+    console_flush();
 }
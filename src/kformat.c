@@ -0,0 +1,257 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+#include "kformat.h"
+
+#define KFORMAT_FLAG_LEFT (1 << 0)
+#define KFORMAT_FLAG_ZERO (1 << 1)
+
+struct kformat_output {
+    char* buffer;
+    size_t position;
+    size_t limit;
+};
+
+static inline void kformat_put(
+    struct kformat_output* output,
+    char c) {
+    if (output->position < output->limit) {
+        output->buffer[output->position++] = c;
+    }
+}
+
+static inline void kformat_pad(
+    struct kformat_output* output,
+    char c,
+    unsigned count) {
+    while (count-- > 0) {
+        kformat_put(output, c);
+    }
+}
+
+static inline void kformat_put_string(
+    struct kformat_output* output,
+    const char* data,
+    size_t length) {
+    size_t available = output->limit - output->position;
+    if (length > available) {
+        length = available;
+    }
+
+    char* destination = output->buffer + output->position;
+    for (size_t i = 0; i < length; i++) {
+        destination[i] = data[i];
+    }
+
+    output->position += length;
+}
+
+// Converts the number straight into the output buffer when it fits, through a
+// scratch buffer when it would be truncated
+static void kformat_put_number(
+    struct kformat_output* output,
+    uint64_t number,
+    unsigned negative,
+    unsigned base,
+    unsigned uppercase,
+    unsigned flags,
+    unsigned width) {
+    char scratch[24];
+    unsigned digits = base == 16
+        ? str_uint64_to_hexstr_len(number)
+        : str_uint64_to_decstr_len(number);
+    unsigned length = digits + negative;
+    unsigned padding = width > length ? width - length : 0;
+
+    if ((flags & (KFORMAT_FLAG_LEFT | KFORMAT_FLAG_ZERO)) == 0) {
+        kformat_pad(output, ' ', padding);
+    }
+
+    if (negative) {
+        kformat_put(output, '-');
+    }
+
+    if ((flags & KFORMAT_FLAG_ZERO) != 0 && (flags & KFORMAT_FLAG_LEFT) == 0) {
+        kformat_pad(output, '0', padding);
+    }
+
+    char* destination = output->limit - output->position >= digits
+        ? output->buffer + output->position
+        : scratch;
+
+    if (base == 16) {
+        str_uint64_to_hexstr_fixed(number, digits, uppercase, destination);
+    } else {
+        str_uint64_to_decstr_fixed(number, digits, destination);
+    }
+
+    if (destination == scratch) {
+        kformat_put_string(output, scratch, digits);
+    } else {
+        output->position += digits;
+    }
+
+    if ((flags & KFORMAT_FLAG_LEFT) != 0) {
+        kformat_pad(output, ' ', padding);
+    }
+}
+
+static void kformat_put_bdf(
+    struct kformat_output* output,
+    unsigned bus,
+    unsigned device,
+    unsigned function) {
+    char bdf[8];
+
+    str_uint64_to_hexstr_fixed(bus, 2, 1, bdf);
+    bdf[2] = ':';
+    str_uint64_to_hexstr_fixed(device, 2, 1, bdf + 3);
+    bdf[5] = ':';
+    str_uint64_to_hexstr_fixed(function, 2, 1, bdf + 6);
+
+    kformat_put_string(output, bdf, sizeof(bdf));
+}
+
+// Formats into the buffer, the result is always NUL terminated and silently
+// truncated if it doesn't fit, returns the length of the formatted string
+size_t kformat_va(
+    char* buffer,
+    size_t buffer_length,
+    const char* format,
+    va_list args) {
+    struct kformat_output output = {
+        .buffer = buffer,
+        .position = 0,
+        .limit = buffer_length > 0 ? buffer_length - 1 : 0,
+    };
+
+    while (*format) {
+        // Copy the literal text up to the next conversion in one go
+        const char* literal = format;
+        while (*format && *format != '%') {
+            format++;
+        }
+
+        if (format != literal) {
+            kformat_put_string(&output, literal, format - literal);
+            continue;
+        }
+
+        format++;
+
+        unsigned flags = 0;
+        for (;; format++) {
+            if (*format == '-') {
+                flags |= KFORMAT_FLAG_LEFT;
+            } else if (*format == '0') {
+                flags |= KFORMAT_FLAG_ZERO;
+            } else {
+                break;
+            }
+        }
+
+        unsigned width = 0;
+        if (*format == '*') {
+            width = va_arg(args, unsigned int);
+            format++;
+        } else {
+            while (*format >= '0' && *format <= '9') {
+                width = width * 10 + (*format++ - '0');
+            }
+        }
+
+        unsigned longs = 0;
+        while (*format == 'l') {
+            longs++;
+            format++;
+        }
+
+        char conversion = *format;
+        if (conversion == 0) {
+            break;
+        }
+        format++;
+
+        switch (conversion) {
+            case 'd': {
+                int64_t value = longs >= 2
+                    ? va_arg(args, long long)
+                    : (longs == 1 ? va_arg(args, long) : va_arg(args, int));
+                unsigned negative = value < 0;
+                uint64_t magnitude = negative ? -(uint64_t)value : (uint64_t)value;
+                kformat_put_number(&output, magnitude, negative, 10, 0, flags, width);
+                break;
+            }
+
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t value = longs >= 2
+                    ? va_arg(args, unsigned long long)
+                    : (longs == 1 ? va_arg(args, unsigned long) : va_arg(args, unsigned int));
+                kformat_put_number(
+                    &output,
+                    value,
+                    0,
+                    conversion == 'u' ? 10 : 16,
+                    conversion == 'X',
+                    flags,
+                    width);
+                break;
+            }
+
+            case 'B': {
+                unsigned bus = va_arg(args, unsigned int);
+                unsigned device = va_arg(args, unsigned int);
+                unsigned function = va_arg(args, unsigned int);
+                kformat_put_bdf(&output, bus, device, function);
+                break;
+            }
+
+            case 's': {
+                const char* value = va_arg(args, const char*);
+                size_t length = str_len(value);
+                unsigned padding = width > length ? width - length : 0;
+
+                if ((flags & KFORMAT_FLAG_LEFT) == 0) {
+                    kformat_pad(&output, ' ', padding);
+                }
+                kformat_put_string(&output, value, length);
+                if ((flags & KFORMAT_FLAG_LEFT) != 0) {
+                    kformat_pad(&output, ' ', padding);
+                }
+                break;
+            }
+
+            case 'c':
+                kformat_put(&output, (char)va_arg(args, int));
+                break;
+
+            default:
+                kformat_put(&output, conversion);
+                break;
+        }
+    }
+
+    if (buffer_length > 0) {
+        buffer[output.position] = 0;
+    }
+
+    return output.position;
+}
+
+size_t kformat(
+    char* buffer,
+    size_t buffer_length,
+    const char* format,
+    ...) {
+    va_list args;
+
+    va_start(args, format);
+    size_t length = kformat_va(buffer, buffer_length, format, args);
+    va_end(args);
+
+    return length;
+}
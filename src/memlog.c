@@ -0,0 +1,26 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memlog.h"
+
+char memlog_ring[MEMLOG_SIZE];
+// The ring is read back from a debugger, memlog_head is the offset of the
+// oldest byte once the ring has wrapped
+size_t memlog_head = 0;
+
+void memlog_write(
+    const char* data,
+    size_t length) {
+    // Only the tail of a write larger than the ring would survive anyway
+    if (length > MEMLOG_SIZE) {
+        data += length - MEMLOG_SIZE;
+        length = MEMLOG_SIZE;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        memlog_ring[memlog_head] = data[i];
+        if (++memlog_head == MEMLOG_SIZE) {
+            memlog_head = 0;
+        }
+    }
+}
@@ -0,0 +1,253 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kformat.h"
+#include "console.h"
+#include "pci.h"
+#include "pci_bar.h"
+#include "mmiobench.h"
+
+#define MMIOBENCH_BDF(bus, device, function) \
+    (((uint16_t)(bus) << 8) | ((device) << 3) | (function))
+
+struct mmiobench_root_port {
+    uint16_t bdf;
+    uint8_t secondary_bus;
+    uint8_t subordinate_bus;
+};
+
+struct mmiobench_root_port mmiobench_root_ports[MMIOBENCH_ROOT_PORTS_MAX];
+unsigned mmiobench_root_ports_count = 0;
+struct mmiobench_result mmiobench_results[MMIOBENCH_DEVICES_MAX];
+unsigned mmiobench_results_count = 0;
+uint32_t mmiobench_samples[MMIOBENCH_SAMPLES];
+uint32_t mmiobench_medians[MMIOBENCH_DEVICES_MAX];
+uint32_t mmiobench_overhead = 0;
+
+// The lfence before rdtsc waits for the previous load to complete, the one
+// after keeps the following load from starting before the timestamp is taken
+static inline uint64_t mmiobench_rdtsc() {
+    uint32_t low, high;
+    asm volatile ("lfence; rdtsc; lfence" : "=a" (low), "=d" (high) : : "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+static void mmiobench_sort(
+    uint32_t* values,
+    unsigned count) {
+    for (unsigned i = 1; i < count; i++) {
+        uint32_t value = values[i];
+        unsigned j = i;
+        while (j > 0 && values[j - 1] > value) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+// Measures the cost of the timestamps alone, subtracted from every sample
+static uint32_t mmiobench_measure_overhead() {
+    uint32_t overhead = UINT32_MAX;
+
+    for (unsigned i = 0; i < MMIOBENCH_SAMPLES; i++) {
+        uint64_t start = mmiobench_rdtsc();
+        uint64_t end = mmiobench_rdtsc();
+        if ((uint32_t)(end - start) < overhead) {
+            overhead = (uint32_t)(end - start);
+        }
+    }
+
+    return overhead;
+}
+
+static void mmiobench_measure(
+    volatile uint32_t* address,
+    struct mmiobench_result* result) {
+    for (unsigned i = 0; i < MMIOBENCH_SAMPLES; i++) {
+        uint64_t start = mmiobench_rdtsc();
+        (void)*address;
+        uint64_t end = mmiobench_rdtsc();
+
+        uint32_t elapsed = (uint32_t)(end - start);
+        mmiobench_samples[i] = elapsed > mmiobench_overhead ? elapsed - mmiobench_overhead : 0;
+    }
+
+    mmiobench_sort(mmiobench_samples, MMIOBENCH_SAMPLES);
+
+    result->min = mmiobench_samples[0];
+    result->median = mmiobench_samples[MMIOBENCH_SAMPLES / 2];
+    result->p99 = mmiobench_samples[(MMIOBENCH_SAMPLES * 99) / 100];
+}
+
+// Returns the root port the bus is behind, a bus behind none of them is a root
+// bus, bus 0 or the one of another host bridge
+static uint32_t mmiobench_find_group(
+    uint8_t bus) {
+    for (unsigned i = 0; i < mmiobench_root_ports_count; i++) {
+        struct mmiobench_root_port* root_port = &mmiobench_root_ports[i];
+        if (bus >= root_port->secondary_bus && bus <= root_port->subordinate_bus) {
+            return root_port->bdf;
+        }
+    }
+
+    return MMIOBENCH_ROOT_BUS(bus);
+}
+
+static int mmiobench_probe_function(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    void* context) {
+    (void)context;
+
+    // The buses are walked in increasing order and a bridge always leads to
+    // higher bus numbers, so the root ports are known by the time the devices
+    // behind them are found. A bridge on a root bus is a root port.
+    if ((pci_get_header_type(bus, device, function) & 0x7F) == 0x01) {
+        if (MMIOBENCH_IS_ROOT_BUS(mmiobench_find_group(bus)) &&
+            mmiobench_root_ports_count < MMIOBENCH_ROOT_PORTS_MAX) {
+            uint32_t buses = pci_config_read_long(bus, device, function, 0x18);
+            struct mmiobench_root_port* root_port =
+                &mmiobench_root_ports[mmiobench_root_ports_count++];
+            root_port->bdf = MMIOBENCH_BDF(bus, device, function);
+            root_port->secondary_bus = (buses >> 8) & 0xFF;
+            root_port->subordinate_bus = (buses >> 16) & 0xFF;
+        }
+
+        return 0;
+    }
+
+    if (mmiobench_results_count == MMIOBENCH_DEVICES_MAX) {
+        return 1;
+    }
+
+    // Nothing can be read if the memory decoding is off
+    if ((pci_config_read_word(bus, device, function, 0x04) & (1 << 1)) == 0) {
+        return 0;
+    }
+
+    // Pick the first memory BAR, normally BAR0, reachable without paging
+    struct pci_bar bar;
+    unsigned registers;
+    for (uint8_t index = 0;
+        (registers = pci_bar_probe(bus, device, function, index, &bar)) > 0;
+        index += registers) {
+        if ((bar.flags & PCI_BAR_FLAG_IO) != 0 || bar.size < 4 || bar.base == 0 ||
+            bar.base + bar.size > 0x100000000ULL) {
+            continue;
+        }
+
+        struct mmiobench_result* result = &mmiobench_results[mmiobench_results_count++];
+        result->bus = bus;
+        result->device = device;
+        result->function = function;
+        result->bar_index = bar.index;
+        result->group = mmiobench_find_group(bus);
+        result->bar_base = bar.base;
+        result->bar_size = bar.size;
+
+        mmiobench_measure((volatile uint32_t*)(uintptr_t)bar.base, result);
+        break;
+    }
+
+    return 0;
+}
+
+// Returns the lower median of the medians of the other functions of the same
+// group, the function being compared would otherwise pull the group
+// median towards itself and, with two functions, always be the upper median
+static uint32_t mmiobench_peers_median(
+    const struct mmiobench_result* result,
+    unsigned* peers) {
+    uint32_t* medians = mmiobench_medians;
+    *peers = 0;
+
+    for (unsigned i = 0; i < mmiobench_results_count; i++) {
+        const struct mmiobench_result* peer = &mmiobench_results[i];
+        if (peer != result && peer->group == result->group) {
+            medians[(*peers)++] = peer->median;
+        }
+    }
+
+    mmiobench_sort(medians, *peers);
+
+    return *peers > 0 ? medians[(*peers - 1) / 2] : 0;
+}
+
+static void mmiobench_print_group(
+    char* buffer,
+    size_t buffer_length,
+    uint32_t group) {
+    if (MMIOBENCH_IS_ROOT_BUS(group)) {
+        kformat(buffer, buffer_length, "root bus %02X", group & 0xFF);
+    } else {
+        kformat(
+            buffer, buffer_length, "root port %B",
+            group >> 8, (group >> 3) & 0x1F, group & 0x7);
+    }
+}
+
+// Times aligned 32-bit reads from offset 0 of the first memory BAR of every
+// function. Paging is disabled, so the BARs are accessed through their
+// physical address and the memory type comes from the MTRRs, which the
+// firmware sets to uncached for the PCI MMIO window.
+void mmiobench_run() {
+    char line[128];
+    char size[24];
+    char group[24];
+    size_t length;
+
+    mmiobench_root_ports_count = 0;
+    mmiobench_results_count = 0;
+    mmiobench_overhead = mmiobench_measure_overhead();
+
+    console_writestring("MMIO READ LATENCY (TSC CYCLES)...\n");
+
+    pci_enumerate(mmiobench_probe_function, NULL);
+
+    for (unsigned i = 0; i < mmiobench_results_count; i++) {
+        struct mmiobench_result* result = &mmiobench_results[i];
+
+        pci_bar_format_size(result->bar_size, size, sizeof(size));
+        mmiobench_print_group(group, sizeof(group), result->group);
+
+        length = kformat(
+            line,
+            sizeof(line),
+            "[%B] BAR%u 0x%08llX (%s), %s: min %u, median %u, p99 %u\n",
+            result->bus, result->device, result->function,
+            result->bar_index,
+            (unsigned long long)result->bar_base,
+            size,
+            group,
+            result->min,
+            result->median,
+            result->p99);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+
+    for (unsigned i = 0; i < mmiobench_results_count; i++) {
+        struct mmiobench_result* result = &mmiobench_results[i];
+        unsigned peers;
+        uint32_t peers_median = mmiobench_peers_median(result, &peers);
+
+        if (peers + 1 < MMIOBENCH_OUTLIER_MIN_FUNCTIONS ||
+            result->median <= peers_median * MMIOBENCH_OUTLIER_FACTOR) {
+            continue;
+        }
+
+        mmiobench_print_group(group, sizeof(group), result->group);
+
+        length = kformat(
+            line,
+            sizeof(line),
+            "[%B] OUTLIER: median %u, median of the others in the %s group %u\n",
+            result->bus, result->device, result->function,
+            result->median,
+            group,
+            peers_median);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+}
@@ -1,9 +1,14 @@
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "inout.h"
-#include "str.h"
+#include "kformat.h"
 #include "console.h"
+#include "acpi.h"
+#include "pci_bar.h"
+#include "pci_sriov.h"
+#include "pci_msi.h"
 
 #include "pci.h"
 
@@ -45,6 +50,175 @@ uint32_t pci_config_read_long(
     return inl(0xCFC);
 }
 
+void pci_config_write_word(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t offset,
+    uint16_t data) {
+    uint32_t address;
+    uint32_t lbus = (uint32_t)bus;
+    uint32_t ldevice = (uint32_t)device;
+    uint32_t lfunc = (uint32_t)func;
+
+    address = (uint32_t)((lbus << 16) | (ldevice << 11) |
+              (lfunc << 8) | (offset & 0xFC) | ((uint32_t)0x80000000));
+
+    outl(0xCF8, address);
+
+    // The word is written straight into the matching half of the data port
+    outw(0xCFC + (offset & 2), data);
+}
+
+void pci_config_write_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t offset,
+    uint32_t data) {
+    uint32_t address;
+    uint32_t lbus = (uint32_t)bus;
+    uint32_t ldevice = (uint32_t)device;
+    uint32_t lfunc = (uint32_t)func;
+
+    address = (uint32_t)((lbus << 16) | (ldevice << 11) |
+              (lfunc << 8) | (offset & 0xFC) | ((uint32_t)0x80000000));
+
+    outl(0xCF8, address);
+    outl(0xCFC, data);
+}
+
+struct pci_mcfg_entry {
+    uint64_t base_address;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed));
+
+volatile uint8_t* pci_ecam_base = NULL;
+uint8_t pci_ecam_start_bus = 0;
+uint8_t pci_ecam_end_bus = 0;
+
+// The extended configuration space (offsets 0x100 to 0xFFF) is only reachable
+// through the memory mapped ECAM window described by the ACPI MCFG table, only
+// a segment 0 window below 4 GiB can be used as paging is not enabled
+int pci_ecam_initialize() {
+    const struct acpi_sdt_header* mcfg = acpi_find_table("MCFG");
+
+    pci_ecam_base = NULL;
+    if (mcfg == NULL) {
+        return 0;
+    }
+
+    const struct pci_mcfg_entry* entries =
+        (const struct pci_mcfg_entry*)((const uint8_t*)(mcfg + 1) + 8);
+    unsigned count = (mcfg->length - sizeof(*mcfg) - 8) / sizeof(struct pci_mcfg_entry);
+
+    for (unsigned i = 0; i < count; i++) {
+        if (entries[i].segment != 0 || entries[i].base_address >= 0x100000000ULL) {
+            continue;
+        }
+
+        pci_ecam_base = (volatile uint8_t*)(uintptr_t)entries[i].base_address;
+        pci_ecam_start_bus = entries[i].start_bus;
+        pci_ecam_end_bus = entries[i].end_bus;
+        return 1;
+    }
+
+    return 0;
+}
+
+static volatile uint32_t* pci_ecam_address(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t offset) {
+    if (pci_ecam_base == NULL || bus < pci_ecam_start_bus || bus > pci_ecam_end_bus) {
+        return NULL;
+    }
+
+    return (volatile uint32_t*)(pci_ecam_base +
+        (((uint32_t)(bus - pci_ecam_start_bus) << 20) |
+         ((uint32_t)device << 15) |
+         ((uint32_t)func << 12) |
+         (offset & 0xFFC)));
+}
+
+uint32_t pci_config_read_ext_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t offset) {
+    volatile uint32_t* address = pci_ecam_address(bus, device, func, offset);
+    return address != NULL ? *address : 0xFFFFFFFF;
+}
+
+void pci_config_write_ext_long(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t offset,
+    uint32_t data) {
+    volatile uint32_t* address = pci_ecam_address(bus, device, func, offset);
+    if (address != NULL) {
+        *address = data;
+    }
+}
+
+// Walks the extended capabilities list, returns the offset of the capability
+// or 0 if missing or if the extended configuration space isn't available
+uint16_t pci_find_ext_capability(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint16_t id) {
+    uint16_t offset = 0x100;
+
+    // Each capability takes at least 4 bytes, bounds the walk on broken lists
+    for (unsigned hops = 0; hops < (0x1000 - 0x100) / 4 && offset >= 0x100; hops++) {
+        uint32_t header = pci_config_read_ext_long(bus, device, func, offset);
+        if (header == 0 || header == 0xFFFFFFFF) {
+            return 0;
+        }
+
+        if ((header & 0xFFFF) == id) {
+            return offset;
+        }
+
+        offset = (header >> 20) & 0xFFC;
+    }
+
+    return 0;
+}
+
+// Walks the capabilities list of the conventional configuration space, returns
+// the offset of the capability or 0 if missing
+uint8_t pci_find_capability(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t func,
+    uint8_t id) {
+    if ((pci_config_read_word(bus, device, func, 0x06) & (1 << 4)) == 0) {
+        return 0;
+    }
+
+    uint8_t pointer_offset = (pci_get_header_type(bus, device, func) & 0x7F) == 0x02 ? 0x14 : 0x34;
+    uint8_t offset = pci_config_read_long(bus, device, func, pointer_offset) & 0xFC;
+
+    // There is room for at most 48 capabilities after the header
+    for (unsigned hops = 0; hops < 48 && offset >= 0x40; hops++) {
+        uint16_t header = pci_config_read_word(bus, device, func, offset);
+        if ((header & 0xFF) == id) {
+            return offset;
+        }
+
+        offset = (header >> 8) & 0xFC;
+    }
+
+    return 0;
+}
+
 uint16_t pci_get_device_id(
     uint8_t bus,
     uint8_t device,
@@ -98,88 +272,163 @@ void pci_print_dev_info(
     uint8_t bus,
     uint8_t device,
     uint8_t function) {
-    char
-        buffer1[25] = { 0 },
-        buffer2[25] = { 0 },
-        buffer3[25] = { 0 },
-        buffer4[25] = { 0 },
-        buffer5[25] = { 0 },
-        buffer6[25] = { 0 },
-        buffer7[25] = { 0 },
-        buffer8[25] = { 0 };
-    unsigned out = 0;
+    char line[96];
 
     uint16_t pci_dev_vendor_id = pci_get_vendor_id(bus, device, function);
     uint16_t pci_dev_dev_id = pci_get_device_id(bus, device, function);
     uint8_t pci_dev_class = pci_get_class(bus, device, function);
     uint8_t pci_dev_subclass = pci_get_subclass(bus, device, function);
     uint8_t pci_dev_rev_id = pci_get_rev_id(bus, device, function);
-    
-    console_writestring("[");
-    console_writestring(str_uint64_to_hexstr((uint64_t)bus, 2, buffer1, sizeof(buffer1)));
-    console_writestring(":");
-    console_writestring(str_uint64_to_hexstr((uint64_t)device, 2, buffer2, sizeof(buffer2)));
-    console_writestring(":");
-    console_writestring(str_uint64_to_hexstr((uint64_t)function, 2, buffer3, sizeof(buffer3)));
-    console_writestring("] ");
-    console_writestring("ID: ");
-    console_writestring(str_uint64_to_hexstr((uint64_t)pci_dev_vendor_id, 4, buffer4, sizeof(buffer4)));
-    console_writestring(":");
-    console_writestring(str_uint64_to_hexstr((uint64_t)pci_dev_dev_id, 4, buffer5, sizeof(buffer5)));
-    console_writestring(", Class: 0x");
-    console_writestring(str_uint64_to_hexstr((uint64_t)pci_dev_class, 2, buffer6, sizeof(buffer6)));
-    console_writestring(", SubClass: 0x");
-    console_writestring(str_uint64_to_hexstr((uint64_t)pci_dev_subclass, 2, buffer7, sizeof(buffer7)));
-    console_writestring(", Rev: ");
-    console_writestring(str_uint64_to_decstr((uint64_t)pci_dev_rev_id, buffer8, sizeof(buffer8), &out));
-    console_writestring("\n");
+
+    size_t length = kformat(
+        line,
+        sizeof(line),
+        "[%B] ID: %04X:%04X, Class: 0x%02X, SubClass: 0x%02X, Rev: %u\n",
+        bus, device, function,
+        pci_dev_vendor_id,
+        pci_dev_dev_id,
+        pci_dev_class,
+        pci_dev_subclass,
+        pci_dev_rev_id);
+
+    console_write(CONSOLE_STREAM_TEXT, line, length);
 }
 
-unsigned pci_check_function(
+// Writes the raw configuration space to the dump stream, 16 bytes per line,
+// the whole 4 KiB when the function is reachable through ECAM
+void pci_dump_config_space(
     uint8_t bus,
     uint8_t device,
     uint8_t function) {
-    uint32_t pci_vendor_id = pci_get_vendor_id(bus, device, function);
-    if (pci_vendor_id == 0xFFFF) {
-        return 0;
+    char line[64];
+
+    if (!console_stream_has_sinks(CONSOLE_STREAM_DUMP)) {
+        return;
     }
 
+    uint16_t size = pci_ecam_address(bus, device, function, 0) != NULL ? 0x1000 : 0x100;
+
+    for (uint16_t offset = 0; offset < size; offset += 16) {
+        uint32_t data[4];
+        for (unsigned i = 0; i < 4; i++) {
+            data[i] = offset < 0x100
+                ? pci_config_read_long(bus, device, function, offset + i * 4)
+                : pci_config_read_ext_long(bus, device, function, offset + i * 4);
+        }
+
+        size_t length = kformat(
+            line, sizeof(line), "%B %03X: %08X %08X %08X %08X\n",
+            bus, device, function, offset,
+            data[0], data[1], data[2], data[3]);
+        console_write(CONSOLE_STREAM_DUMP, line, length);
+    }
+}
+
+// Prints the device line followed by the details of the capabilities
+void pci_print_function(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
     pci_print_dev_info(bus, device, function);
+    pci_dump_config_space(bus, device, function);
+    pci_bar_print_info(bus, device, function);
+    pci_bar_print_rebar_info(bus, device, function);
+    pci_sriov_print_info(bus, device, function);
+    pci_msi_print_info(bus, device, function);
+}
 
-    return 1;
+static int pci_check_function_callback(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    void* context) {
+    (void)context;
+    pci_print_function(bus, device, function);
+    return 0;
 }
 
-unsigned pci_check_device(
+// Invokes the callback for every function of the device, the walk stops as
+// soon as the callback returns a non-zero value which is then returned
+static int pci_enumerate_device(
     uint8_t bus,
-    uint8_t device) {
+    uint8_t device,
+    pci_enumerate_fn_t callback,
+    void* context) {
     uint8_t function = 0;
+    int ret;
 
-    uint16_t pci_vendor_id = pci_get_vendor_id(bus, device, function);
-    if (pci_vendor_id == 0xFFFF) {
+    if (pci_get_vendor_id(bus, device, function) == 0xFFFF) {
         return 0;
     }
-    
-    pci_print_dev_info(bus, device, function);
-    
+
+    if ((ret = callback(bus, device, function, context)) != 0) {
+        return ret;
+    }
+
     uint8_t header_type = pci_get_header_type(bus, device, function);
     if ((header_type & 0x80) != 0) {
         // It's a multi-function device, so check remaining functions
         for (function = 1; function < 8; function++) {
-            pci_check_function(bus, device, function);
+            if (pci_get_vendor_id(bus, device, function) == 0xFFFF) {
+                continue;
+            }
+
+            if ((ret = callback(bus, device, function, context)) != 0) {
+                return ret;
+            }
         }
     }
 
+    return 0;
+}
+
+unsigned pci_check_function(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    uint32_t pci_vendor_id = pci_get_vendor_id(bus, device, function);
+    if (pci_vendor_id == 0xFFFF) {
+        return 0;
+    }
+
+    pci_print_function(bus, device, function);
+
+    return 1;
+}
+
+unsigned pci_check_device(
+    uint8_t bus,
+    uint8_t device) {
+    if (pci_get_vendor_id(bus, device, 0) == 0xFFFF) {
+        return 0;
+    }
+
+    pci_enumerate_device(bus, device, pci_check_function_callback, NULL);
+
     return 1;
 }
 
 void pci_check_all_buses() {
+    pci_enumerate(pci_check_function_callback, NULL);
+}
+
+// Walks all the buses and invokes the callback for every function found, the
+// walk stops as soon as the callback returns a non-zero value which is then
+// returned
+int pci_enumerate(
+    pci_enumerate_fn_t callback,
+    void* context) {
     uint16_t bus;
     uint8_t device;
+    int ret;
 
     for (bus = 0; bus < 256; bus++) {
-        device = 0;
         for (device = 0; device < 32; device++) {
-            pci_check_device(bus, device);
+            if ((ret = pci_enumerate_device(bus, device, callback, context)) != 0) {
+                return ret;
+            }
         }
     }
+
+    return 0;
 }
@@ -0,0 +1,397 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kformat.h"
+#include "console.h"
+#include "pci.h"
+#include "pci_bar.h"
+
+#define PCI_COMMAND_OFFSET 0x04
+#define PCI_COMMAND_IO_SPACE (1 << 0)
+#define PCI_COMMAND_MEMORY_SPACE (1 << 1)
+#define PCI_BAR_OFFSET(index) (0x10 + (index) * 4)
+
+#define PCI_CLASS_BRIDGE 0x06
+#define PCI_SUBCLASS_HOST_BRIDGE 0x00
+
+#define PCI_REBAR_CAPABILITY(entry) (0x04 + (entry) * 8)
+#define PCI_REBAR_CONTROL(entry) (0x08 + (entry) * 8)
+#define PCI_REBAR_ENTRIES_MAX 6
+
+struct pci_bar_finding {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint8_t index;
+    uint64_t current;
+    uint64_t maximum;
+};
+
+struct pci_bar_finding pci_bar_findings[PCI_BAR_FINDINGS_MAX];
+unsigned pci_bar_findings_count = 0;
+unsigned pci_bar_findings_dropped = 0;
+unsigned pci_bar_low_placements = 0;
+
+// Type 0 headers have 6 BARs, PCI-to-PCI bridges only 2
+unsigned pci_bar_count(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    switch (pci_get_header_type(bus, device, function) & 0x7F) {
+        case 0x00:
+            return 6;
+        case 0x01:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static inline uint32_t pci_bar_read(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t offset,
+    unsigned extended) {
+    return extended
+        ? pci_config_read_ext_long(bus, device, function, offset)
+        : pci_config_read_long(bus, device, function, (uint8_t)offset);
+}
+
+static inline void pci_bar_write(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t offset,
+    unsigned extended,
+    uint32_t data) {
+    if (extended) {
+        pci_config_write_ext_long(bus, device, function, offset, data);
+    } else {
+        pci_config_write_long(bus, device, function, (uint8_t)offset, data);
+    }
+}
+
+// Decodes the BAR register at offset, in the conventional configuration space
+// or, if extended, in the extended one, and sizes it writing all ones and
+// reading back the mask, the original content is restored afterwards. The
+// caller disables the decoding of the BAR around the call. Returns the number
+// of registers used by the BAR, 2 for 64-bit BARs when allowed.
+unsigned pci_bar_size(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t offset,
+    unsigned extended,
+    unsigned allow_64bit,
+    struct pci_bar* bar) {
+    uint32_t low = pci_bar_read(bus, device, function, offset, extended);
+    uint32_t high = 0;
+    unsigned registers = 1;
+
+    bar->flags = 0;
+
+    if ((low & 1) != 0) {
+        bar->flags |= PCI_BAR_FLAG_IO;
+    } else {
+        if (((low >> 1) & 0x3) == 0x2 && allow_64bit) {
+            bar->flags |= PCI_BAR_FLAG_64BIT;
+            registers = 2;
+            high = pci_bar_read(bus, device, function, offset + 4, extended);
+        }
+
+        if ((low & (1 << 3)) != 0) {
+            bar->flags |= PCI_BAR_FLAG_PREFETCHABLE;
+        }
+    }
+
+    pci_bar_write(bus, device, function, offset, extended, 0xFFFFFFFF);
+    uint32_t mask_low = pci_bar_read(bus, device, function, offset, extended);
+    pci_bar_write(bus, device, function, offset, extended, low);
+
+    uint32_t mask_high = 0xFFFFFFFF;
+    if (registers == 2) {
+        pci_bar_write(bus, device, function, offset + 4, extended, 0xFFFFFFFF);
+        mask_high = pci_bar_read(bus, device, function, offset + 4, extended);
+        pci_bar_write(bus, device, function, offset + 4, extended, high);
+    }
+
+    if ((bar->flags & PCI_BAR_FLAG_IO) != 0) {
+        uint32_t mask = mask_low & ~0x3U;
+        bar->base = low & ~0x3U;
+
+        // I/O BARs may only implement the lower 16 bits
+        if (mask != 0 && (mask & 0xFFFF0000) == 0) {
+            mask |= 0xFFFF0000;
+        }
+        bar->size = mask == 0 ? 0 : (uint32_t)(~mask + 1);
+    } else {
+        uint64_t mask = ((uint64_t)mask_high << 32) | (mask_low & ~0xFU);
+        bar->base = ((uint64_t)high << 32) | (low & ~0xFU);
+        bar->size = (uint32_t)mask == 0 && (registers == 1 || mask_high == 0)
+            ? 0
+            : ~mask + 1;
+    }
+
+    return registers;
+}
+
+// Decodes and sizes one of the BARs of the function with the IO and memory
+// decoding disabled while the BAR holds the probe value. Host bridges keep
+// decoding, as in Linux, since turning it off breaks some chipsets. Returns the
+// number of registers used by the BAR, 2 for 64-bit BARs, or 0 if the index is
+// out of range.
+unsigned pci_bar_probe(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint8_t index,
+    struct pci_bar* bar) {
+    unsigned count = pci_bar_count(bus, device, function);
+    if (index >= count) {
+        return 0;
+    }
+
+    unsigned host_bridge =
+        pci_get_class(bus, device, function) == PCI_CLASS_BRIDGE &&
+        pci_get_subclass(bus, device, function) == PCI_SUBCLASS_HOST_BRIDGE;
+
+    uint16_t command = pci_config_read_word(bus, device, function, PCI_COMMAND_OFFSET);
+    if (!host_bridge) {
+        pci_config_write_word(
+            bus, device, function, PCI_COMMAND_OFFSET,
+            command & ~(PCI_COMMAND_IO_SPACE | PCI_COMMAND_MEMORY_SPACE));
+    }
+
+    bar->index = index;
+    unsigned registers = pci_bar_size(
+        bus, device, function, PCI_BAR_OFFSET(index), 0, index + 1U < count, bar);
+
+    if (!host_bridge) {
+        pci_config_write_word(bus, device, function, PCI_COMMAND_OFFSET, command);
+    }
+
+    return registers;
+}
+
+size_t pci_bar_format_size(
+    uint64_t size,
+    char* buffer,
+    size_t buffer_length) {
+    static const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    unsigned unit = 0;
+
+    while (unit < 4 && size >= 1024 && (size & 1023) == 0) {
+        size >>= 10;
+        unit++;
+    }
+
+    return kformat(buffer, buffer_length, "%llu %s", (unsigned long long)size, units[unit]);
+}
+
+// Prints type, width, prefetchability, address and size of every implemented
+// BAR, 64-bit prefetchable BARs placed below 4 GiB are flagged as they waste
+// the scarce 32-bit MMIO window and cap the BAR size
+void pci_bar_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[128];
+    char size[24];
+    size_t length;
+    unsigned registers;
+    struct pci_bar bar;
+
+    for (uint8_t index = 0;
+        (registers = pci_bar_probe(bus, device, function, index, &bar)) > 0;
+        index += registers) {
+        if (bar.size == 0) {
+            continue;
+        }
+
+        pci_bar_format_size(bar.size, size, sizeof(size));
+
+        if ((bar.flags & PCI_BAR_FLAG_IO) != 0) {
+            length = kformat(
+                line, sizeof(line), "    BAR%u: io 0x%04llX (%s)\n",
+                bar.index, (unsigned long long)bar.base, size);
+            console_write(CONSOLE_STREAM_TEXT, line, length);
+            continue;
+        }
+
+        unsigned low_placement =
+            (bar.flags & (PCI_BAR_FLAG_64BIT | PCI_BAR_FLAG_PREFETCHABLE)) ==
+                (PCI_BAR_FLAG_64BIT | PCI_BAR_FLAG_PREFETCHABLE) &&
+            bar.base != 0 &&
+            bar.base < 0x100000000ULL;
+
+        length = kformat(
+            line, sizeof(line), "    BAR%u: mem %s%s 0x%0*llX (%s)%s\n",
+            bar.index,
+            (bar.flags & PCI_BAR_FLAG_64BIT) != 0 ? "64-bit" : "32-bit",
+            (bar.flags & PCI_BAR_FLAG_PREFETCHABLE) != 0 ? " prefetchable" : "",
+            (bar.flags & PCI_BAR_FLAG_64BIT) != 0 ? 16 : 8,
+            (unsigned long long)bar.base,
+            size,
+            low_placement ? " [below 4 GiB]" : "");
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+
+        pci_bar_low_placements += low_placement;
+    }
+}
+
+// Sizes are encoded as 2^n MiB, bits 4 to 31 of the capability register cover
+// 1 MiB to 128 TiB and bits 16 to 31 of the control register the larger ones
+static uint64_t pci_bar_rebar_max_size(
+    uint32_t capability,
+    uint32_t control) {
+    uint32_t extended = control >> 16;
+    uint32_t supported = capability >> 4;
+
+    if (extended != 0) {
+        return 1ULL << (20 + 28 + (31 - __builtin_clz(extended)));
+    }
+
+    if (supported != 0) {
+        return 1ULL << (20 + (31 - __builtin_clz(supported)));
+    }
+
+    return 0;
+}
+
+static uint64_t pci_bar_rebar_min_size(
+    uint32_t capability,
+    uint32_t control) {
+    uint32_t supported = capability >> 4;
+    uint32_t extended = control >> 16;
+
+    if (supported != 0) {
+        return 1ULL << (20 + __builtin_ctz(supported));
+    }
+
+    if (extended != 0) {
+        return 1ULL << (20 + 28 + __builtin_ctz(extended));
+    }
+
+    return 0;
+}
+
+static void pci_bar_record_finding(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint8_t index,
+    uint64_t current,
+    uint64_t maximum) {
+    if (pci_bar_findings_count == PCI_BAR_FINDINGS_MAX) {
+        pci_bar_findings_dropped++;
+        return;
+    }
+
+    struct pci_bar_finding* finding = &pci_bar_findings[pci_bar_findings_count++];
+    finding->bus = bus;
+    finding->device = device;
+    finding->function = function;
+    finding->index = index;
+    finding->current = current;
+    finding->maximum = maximum;
+}
+
+void pci_bar_print_rebar_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[128];
+    char current_size[24];
+    char min_size[24];
+    char max_size[24];
+    size_t length;
+
+    uint16_t rebar = pci_find_ext_capability(bus, device, function, PCI_EXT_CAP_ID_REBAR);
+    if (rebar == 0) {
+        return;
+    }
+
+    // The number of resizable BARs is only reported by the first entry, the
+    // reserved values 0 and 7 give no way to tell where the capability ends
+    uint32_t control = pci_config_read_ext_long(bus, device, function, rebar + PCI_REBAR_CONTROL(0));
+    unsigned entries = (control >> 5) & 0x7;
+    if (entries == 0 || entries > PCI_REBAR_ENTRIES_MAX) {
+        length = kformat(
+            line, sizeof(line), "    Resizable BAR: invalid number of BARs %u, skipped\n", entries);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+        return;
+    }
+
+    for (unsigned entry = 0; entry < entries; entry++) {
+        uint32_t capability = pci_config_read_ext_long(
+            bus, device, function, rebar + PCI_REBAR_CAPABILITY(entry));
+        control = pci_config_read_ext_long(
+            bus, device, function, rebar + PCI_REBAR_CONTROL(entry));
+
+        uint8_t index = control & 0x7;
+        unsigned encoded_size = (control >> 8) & 0x3F;
+        uint64_t current = encoded_size <= 43 ? 1ULL << (20 + encoded_size) : 0;
+        uint64_t minimum = pci_bar_rebar_min_size(capability, control);
+        uint64_t maximum = pci_bar_rebar_max_size(capability, control);
+
+        pci_bar_format_size(current, current_size, sizeof(current_size));
+        pci_bar_format_size(minimum, min_size, sizeof(min_size));
+        pci_bar_format_size(maximum, max_size, sizeof(max_size));
+
+        length = kformat(
+            line, sizeof(line), "    Resizable BAR%u: current %s, supported %s-%s%s\n",
+            index,
+            current_size,
+            min_size,
+            max_size,
+            current < maximum ? " [sub-maximal]" : "");
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+
+        if (current < maximum) {
+            pci_bar_record_finding(bus, device, function, index, current, maximum);
+        }
+    }
+}
+
+// Prints the resizable BARs left below their maximum size found during the
+// scan and clears the findings
+void pci_bar_print_summary() {
+    char line[128];
+    char current_size[24];
+    char max_size[24];
+    size_t length;
+
+    length = kformat(
+        line, sizeof(line),
+        "BAR AUDIT: %u sub-maximal resizable BARs, %u 64-bit prefetchable BARs below 4 GiB\n",
+        pci_bar_findings_count + pci_bar_findings_dropped,
+        pci_bar_low_placements);
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+
+    for (unsigned i = 0; i < pci_bar_findings_count; i++) {
+        struct pci_bar_finding* finding = &pci_bar_findings[i];
+
+        pci_bar_format_size(finding->current, current_size, sizeof(current_size));
+        pci_bar_format_size(finding->maximum, max_size, sizeof(max_size));
+
+        length = kformat(
+            line, sizeof(line), "[%B] BAR%u: %s of %s\n",
+            finding->bus, finding->device, finding->function,
+            finding->index,
+            current_size,
+            max_size);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+
+    if (pci_bar_findings_dropped > 0) {
+        length = kformat(
+            line, sizeof(line), "%u more not listed\n", pci_bar_findings_dropped);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+
+    pci_bar_findings_count = 0;
+    pci_bar_findings_dropped = 0;
+    pci_bar_low_placements = 0;
+}
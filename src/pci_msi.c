@@ -0,0 +1,215 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kformat.h"
+#include "console.h"
+#include "pci.h"
+#include "pci_msi.h"
+
+#define PCI_INTERRUPT_OFFSET 0x3C
+
+#define PCI_MSI_CONTROL_ENABLE (1 << 0)
+#define PCI_MSI_CONTROL_64BIT (1 << 7)
+#define PCI_MSI_CONTROL_MASKABLE (1 << 8)
+
+#define PCI_MSIX_CONTROL_MASK (1 << 14)
+#define PCI_MSIX_CONTROL_ENABLE (1 << 15)
+#define PCI_MSIX_TABLE_OFFSET 0x04
+#define PCI_MSIX_PBA_OFFSET 0x08
+
+// Only the mass storage and network controllers are expected to spread their
+// queues over all the CPUs
+#define PCI_MSI_CLASS_MASS_STORAGE 0x01
+#define PCI_MSI_CLASS_NETWORK 0x02
+
+unsigned pci_msi_cpus = 1;
+
+void pci_msi_set_cpu_count(
+    unsigned cpus) {
+    pci_msi_cpus = cpus > 0 ? cpus : 1;
+}
+
+static unsigned pci_msi_msi_vectors(
+    uint16_t control) {
+    return 1 << ((control >> 1) & 0x7);
+}
+
+static unsigned pci_msi_msix_vectors(
+    uint16_t control) {
+    return (control & 0x7FF) + 1;
+}
+
+static uint8_t pci_msi_interrupt_pin(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    return (pci_config_read_long(bus, device, function, PCI_INTERRUPT_OFFSET) >> 8) & 0xFF;
+}
+
+// Returns 1 if the function is a storage or network controller that can only
+// use INTx or whose vectors can't give a queue to every CPU, the vectors are
+// the larger of the MSI and MSI-X ones, 0 when INTx only
+static int pci_msi_is_short(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    unsigned* vectors) {
+    uint8_t class = pci_get_class(bus, device, function);
+    if (class != PCI_MSI_CLASS_MASS_STORAGE && class != PCI_MSI_CLASS_NETWORK) {
+        return 0;
+    }
+
+    *vectors = 0;
+
+    uint8_t msi = pci_find_capability(bus, device, function, PCI_CAP_ID_MSI);
+    if (msi != 0) {
+        *vectors = pci_msi_msi_vectors(pci_config_read_word(bus, device, function, msi + 2));
+    }
+
+    uint8_t msix = pci_find_capability(bus, device, function, PCI_CAP_ID_MSIX);
+    if (msix != 0) {
+        unsigned msix_vectors = pci_msi_msix_vectors(
+            pci_config_read_word(bus, device, function, msix + 2));
+        if (msix_vectors > *vectors) {
+            *vectors = msix_vectors;
+        }
+    }
+
+    if (*vectors == 0) {
+        return pci_msi_interrupt_pin(bus, device, function) != 0;
+    }
+
+    return *vectors < pci_msi_cpus;
+}
+
+static void pci_msi_print_msi(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[128];
+    size_t length;
+
+    uint8_t msi = pci_find_capability(bus, device, function, PCI_CAP_ID_MSI);
+    if (msi == 0) {
+        return;
+    }
+
+    uint16_t control = pci_config_read_word(bus, device, function, msi + 2);
+    const char* width = (control & PCI_MSI_CONTROL_64BIT) != 0 ? ", 64-bit" : "";
+    const char* masking = (control & PCI_MSI_CONTROL_MASKABLE) != 0 ? ", per-vector masking" : "";
+
+    if ((control & PCI_MSI_CONTROL_ENABLE) != 0) {
+        length = kformat(
+            line, sizeof(line), "    MSI: %u vectors%s%s, enabled with %u\n",
+            pci_msi_msi_vectors(control), width, masking, 1 << ((control >> 4) & 0x7));
+    } else {
+        length = kformat(
+            line, sizeof(line), "    MSI: %u vectors%s%s, disabled\n",
+            pci_msi_msi_vectors(control), width, masking);
+    }
+
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+}
+
+static void pci_msi_print_msix(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[128];
+
+    uint8_t msix = pci_find_capability(bus, device, function, PCI_CAP_ID_MSIX);
+    if (msix == 0) {
+        return;
+    }
+
+    uint16_t control = pci_config_read_word(bus, device, function, msix + 2);
+    uint32_t table = pci_config_read_long(bus, device, function, msix + PCI_MSIX_TABLE_OFFSET);
+    uint32_t pba = pci_config_read_long(bus, device, function, msix + PCI_MSIX_PBA_OFFSET);
+
+    size_t length = kformat(
+        line, sizeof(line),
+        "    MSI-X: %u vectors, table BAR%u+0x%X, PBA BAR%u+0x%X, %s%s\n",
+        pci_msi_msix_vectors(control),
+        table & 0x7, table & ~0x7U,
+        pba & 0x7, pba & ~0x7U,
+        (control & PCI_MSIX_CONTROL_ENABLE) != 0 ? "enabled" : "disabled",
+        (control & PCI_MSIX_CONTROL_MASK) != 0 ? ", function masked" : "");
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+}
+
+// Prints the legacy interrupt routing and the MSI / MSI-X capabilities, the
+// storage and network controllers whose vectors can't give a queue to every
+// CPU, or that can only use INTx, are flagged
+void pci_msi_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[128];
+    size_t length;
+    unsigned vectors;
+
+    pci_msi_print_msi(bus, device, function);
+    pci_msi_print_msix(bus, device, function);
+
+    uint32_t interrupt = pci_config_read_long(bus, device, function, PCI_INTERRUPT_OFFSET);
+    uint8_t pin = (interrupt >> 8) & 0xFF;
+    if (pin >= 1 && pin <= 4) {
+        length = kformat(
+            line, sizeof(line), "    INTx: pin INT%c, line %u\n", 'A' + pin - 1, interrupt & 0xFF);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+
+    if (!pci_msi_is_short(bus, device, function, &vectors)) {
+        return;
+    }
+
+    if (vectors == 0) {
+        console_writestring("    [INTx only]\n");
+    } else {
+        length = kformat(
+            line, sizeof(line), "    [%u vectors for %u CPUs]\n", vectors, pci_msi_cpus);
+        console_write(CONSOLE_STREAM_TEXT, line, length);
+    }
+}
+
+static int pci_msi_print_summary_function(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    void* context) {
+    char line[64];
+    size_t length;
+    unsigned vectors;
+
+    if (!pci_msi_is_short(bus, device, function, &vectors)) {
+        return 0;
+    }
+
+    if (vectors == 0) {
+        length = kformat(line, sizeof(line), "[%B] INTx only\n", bus, device, function);
+    } else {
+        length = kformat(line, sizeof(line), "[%B] %u vectors\n", bus, device, function, vectors);
+    }
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+
+    (*(unsigned*)context)++;
+    return 0;
+}
+
+// Walks the buses again rather than keeping the flagged controllers around,
+// the check only takes a few configuration space reads per function
+void pci_msi_print_summary() {
+    char line[96];
+    size_t length;
+    unsigned flagged = 0;
+
+    length = kformat(line, sizeof(line), "INTERRUPT AUDIT: %u CPUs\n", pci_msi_cpus);
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+
+    pci_enumerate(pci_msi_print_summary_function, &flagged);
+
+    length = kformat(
+        line, sizeof(line), "%u storage and network controllers without a vector per CPU\n", flagged);
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+}
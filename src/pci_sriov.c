@@ -0,0 +1,201 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kformat.h"
+#include "console.h"
+#include "pci.h"
+#include "pci_bar.h"
+#include "pci_sriov.h"
+
+#define PCI_SRIOV_CONTROL 0x08
+#define PCI_SRIOV_TOTAL_VFS 0x0C
+#define PCI_SRIOV_NUM_VFS 0x10
+#define PCI_SRIOV_VF_OFFSET 0x14
+#define PCI_SRIOV_VF_DEVICE_ID 0x18
+#define PCI_SRIOV_VF_BAR(index) (0x24 + (index) * 4)
+#define PCI_SRIOV_VF_BARS 6
+
+#define PCI_SRIOV_CONTROL_VF_ENABLE (1 << 0)
+#define PCI_SRIOV_CONTROL_VF_MSE (1 << 3)
+
+#define PCI_ROUTING_ID_BUS(rid) ((rid) >> 8)
+#define PCI_ROUTING_ID_DEVICE(rid) (((rid) >> 3) & 0x1F)
+#define PCI_ROUTING_ID_FUNCTION(rid) ((rid) & 0x7)
+
+// The VF BARs are sized like the BARs of the function, with the VF memory
+// decoding disabled, the size is the one of every single VF
+static unsigned pci_sriov_probe_vf_bar(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t capability,
+    uint8_t index,
+    struct pci_bar* bar) {
+    uint32_t control = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_CONTROL);
+    pci_config_write_ext_long(
+        bus, device, function, capability + PCI_SRIOV_CONTROL,
+        control & ~PCI_SRIOV_CONTROL_VF_MSE);
+
+    bar->index = index;
+    unsigned registers = pci_bar_size(
+        bus, device, function, capability + PCI_SRIOV_VF_BAR(index), 1,
+        index + 1 < PCI_SRIOV_VF_BARS, bar);
+
+    pci_config_write_ext_long(
+        bus, device, function, capability + PCI_SRIOV_CONTROL, control);
+
+    return registers;
+}
+
+static void pci_sriov_print_vf_bars(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t capability) {
+    char line[192];
+    char size[24];
+    size_t length = kformat(line, sizeof(line), "    SR-IOV VF BARs:");
+    unsigned found = 0;
+    unsigned registers;
+    struct pci_bar bar;
+
+    for (uint8_t index = 0; index < PCI_SRIOV_VF_BARS; index += registers) {
+        registers = pci_sriov_probe_vf_bar(bus, device, function, capability, index, &bar);
+        if (bar.size == 0) {
+            continue;
+        }
+
+        pci_bar_format_size(bar.size, size, sizeof(size));
+        length += kformat(
+            line + length,
+            sizeof(line) - length,
+            "%s BAR%u %s%s%s",
+            found++ > 0 ? "," : "",
+            bar.index,
+            size,
+            (bar.flags & PCI_BAR_FLAG_64BIT) != 0 ? " 64-bit" : "",
+            (bar.flags & PCI_BAR_FLAG_PREFETCHABLE) != 0 ? " prefetchable" : "");
+    }
+
+    if (found == 0) {
+        length += kformat(line + length, sizeof(line) - length, " none");
+    }
+
+    length += kformat(line + length, sizeof(line) - length, "\n");
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+}
+
+// First VF Offset and VF Stride are only valid for the NumVFs currently
+// programmed. While VF Enable is clear NumVFs is set to TotalVFs for the time
+// of the read, as Linux does to size the VF bus range, so the layout of all
+// the VFs the device can expose is known before they are enabled.
+static uint32_t pci_sriov_read_offset_stride(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function,
+    uint16_t capability,
+    uint32_t num_vfs) {
+    uint32_t num_vfs_register = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_NUM_VFS);
+
+    if ((num_vfs_register & 0xFFFF) == num_vfs) {
+        return pci_config_read_ext_long(
+            bus, device, function, capability + PCI_SRIOV_VF_OFFSET);
+    }
+
+    pci_config_write_ext_long(
+        bus, device, function, capability + PCI_SRIOV_NUM_VFS,
+        (num_vfs_register & ~0xFFFFU) | num_vfs);
+    uint32_t vf_offset_stride = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_VF_OFFSET);
+    pci_config_write_ext_long(
+        bus, device, function, capability + PCI_SRIOV_NUM_VFS, num_vfs_register);
+
+    return vf_offset_stride;
+}
+
+// The VFs don't show up in the bus walk, their routing IDs are computed from
+// the PF one as PF + First VF Offset + n * VF Stride and, being an arithmetic
+// progression, are reported as a single range whatever the number of VFs. The
+// range covers NumVFs once VF Enable is set and TotalVFs before.
+void pci_sriov_print_info(
+    uint8_t bus,
+    uint8_t device,
+    uint8_t function) {
+    char line[192];
+    size_t length;
+
+    uint16_t capability = pci_find_ext_capability(
+        bus, device, function, PCI_EXT_CAP_ID_SRIOV);
+    if (capability == 0) {
+        return;
+    }
+
+    uint32_t control = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_CONTROL);
+    uint32_t total_vfs = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_TOTAL_VFS) >> 16;
+    uint32_t num_vfs = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_NUM_VFS) & 0xFFFF;
+    uint32_t vf_device_id = pci_config_read_ext_long(
+        bus, device, function, capability + PCI_SRIOV_VF_DEVICE_ID) >> 16;
+    uint16_t vendor_id = pci_get_vendor_id(bus, device, function);
+
+    unsigned vf_enable = (control & PCI_SRIOV_CONTROL_VF_ENABLE) != 0;
+    uint32_t range_vfs = vf_enable ? num_vfs : total_vfs;
+    uint32_t vf_offset_stride = pci_sriov_read_offset_stride(
+        bus, device, function, capability, range_vfs);
+    uint32_t vf_offset = vf_offset_stride & 0xFFFF;
+    uint32_t vf_stride = vf_offset_stride >> 16;
+    uint32_t pf_rid = ((uint32_t)bus << 8) | ((uint32_t)device << 3) | function;
+
+    length = kformat(
+        line,
+        sizeof(line),
+        "    SR-IOV: VFs %u/%u%s, VF ID %04X:%04X",
+        num_vfs,
+        total_vfs,
+        vf_enable ? "" : " (VF Enable off)",
+        vendor_id,
+        vf_device_id);
+
+    if (range_vfs > 0) {
+        uint32_t first_rid = pf_rid + vf_offset;
+        uint32_t last_rid = first_rid + (range_vfs - 1) * vf_stride;
+
+        if (last_rid > 0xFFFF) {
+            length += kformat(
+                line + length,
+                sizeof(line) - length,
+                ", invalid routing IDs (offset %u, stride %u)",
+                vf_offset,
+                vf_stride);
+        } else {
+            length += kformat(
+                line + length,
+                sizeof(line) - length,
+                ", [%B]-[%B] stride %u",
+                PCI_ROUTING_ID_BUS(first_rid),
+                PCI_ROUTING_ID_DEVICE(first_rid),
+                PCI_ROUTING_ID_FUNCTION(first_rid),
+                PCI_ROUTING_ID_BUS(last_rid),
+                PCI_ROUTING_ID_DEVICE(last_rid),
+                PCI_ROUTING_ID_FUNCTION(last_rid),
+                vf_stride);
+        }
+
+        length += kformat(
+            line + length,
+            sizeof(line) - length,
+            " for %s %u",
+            vf_enable ? "NumVFs" : "TotalVFs",
+            range_vfs);
+    }
+
+    length += kformat(line + length, sizeof(line) - length, "\n");
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+
+    pci_sriov_print_vf_bars(bus, device, function, capability);
+}
@@ -0,0 +1,232 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inout.h"
+#include "kformat.h"
+#include "console.h"
+#include "interrupts.h"
+#include "profiler.h"
+
+#define PROFILER_PIT_FREQUENCY 1193182
+#define PROFILER_PIT_CHANNEL0 0x40
+#define PROFILER_PIT_COMMAND 0x43
+#define PROFILER_PIT_IRQ 0
+
+struct profiler_entry {
+    uint32_t address;
+    uint32_t count;
+};
+
+// Open addressing hash table keyed by the interrupted EIP, samples landing
+// when the table is full are only counted as dropped
+struct profiler_entry profiler_histogram[PROFILER_HISTOGRAM_SIZE];
+volatile uint32_t profiler_samples = 0;
+volatile uint32_t profiler_dropped = 0;
+
+// Scratch space for the report, one entry per function hit by the samples
+struct profiler_entry profiler_functions[PROFILER_HISTOGRAM_SIZE];
+
+void isr_profiler_timer();
+
+// Called from the timer interrupt, must be kept short
+void profiler_sample(
+    uint32_t eip) {
+    uint32_t index = (eip * 2654435761U) >> (32 - PROFILER_HISTOGRAM_BITS);
+
+    profiler_samples++;
+
+    for (unsigned probes = 0; probes < PROFILER_HISTOGRAM_SIZE; probes++) {
+        struct profiler_entry* entry = &profiler_histogram[index];
+
+        if (entry->address == eip) {
+            entry->count++;
+            return;
+        }
+
+        if (entry->count == 0) {
+            entry->address = eip;
+            entry->count = 1;
+            return;
+        }
+
+        index = (index + 1) & (PROFILER_HISTOGRAM_SIZE - 1);
+    }
+
+    profiler_dropped++;
+}
+
+// Programs the PIT channel 0 as rate generator and enables the interrupts, the
+// interrupts need to be initialized first
+void profiler_start(
+    uint32_t hz) {
+    if (hz == 0) {
+        hz = PROFILER_DEFAULT_HZ;
+    }
+
+    uint32_t divisor = PROFILER_PIT_FREQUENCY / hz;
+    if (divisor == 0) {
+        divisor = 1;
+    } else if (divisor > 0xFFFF) {
+        divisor = 0xFFFF;
+    }
+
+    for (unsigned i = 0; i < PROFILER_HISTOGRAM_SIZE; i++) {
+        profiler_histogram[i].address = 0;
+        profiler_histogram[i].count = 0;
+    }
+    profiler_samples = 0;
+    profiler_dropped = 0;
+
+    interrupts_set_handler(INTERRUPTS_IRQ_BASE + PROFILER_PIT_IRQ, isr_profiler_timer);
+
+    outb(PROFILER_PIT_COMMAND, 0x34);
+    outb(PROFILER_PIT_CHANNEL0, divisor & 0xFF);
+    outb(PROFILER_PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+
+    interrupts_unmask_irq(PROFILER_PIT_IRQ);
+    interrupts_enable();
+}
+
+void profiler_stop() {
+    interrupts_disable();
+    interrupts_mask_irq(PROFILER_PIT_IRQ);
+}
+
+// Returns the index of the symbol containing the address, the last symbol
+// starting at or before it, or -1 if the address precedes all the symbols
+static int profiler_find_symbol(
+    uint32_t address) {
+    int low = 0;
+    int high = (int)profiler_symbols_count - 1;
+    int found = -1;
+
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (profiler_symbols[middle].address <= address) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return found;
+}
+
+// Picks the entry with the highest count and clears it, so repeated calls
+// return the entries in descending order
+static struct profiler_entry profiler_take_top(
+    struct profiler_entry* entries,
+    unsigned count) {
+    struct profiler_entry top = { 0, 0 };
+    unsigned top_index = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (entries[i].count > top.count) {
+            top = entries[i];
+            top_index = i;
+        }
+    }
+
+    entries[top_index].count = 0;
+
+    return top;
+}
+
+static void profiler_format_symbol(
+    uint32_t address,
+    unsigned with_offset,
+    char* buffer,
+    size_t buffer_length) {
+    int symbol = profiler_find_symbol(address);
+
+    if (symbol < 0) {
+        kformat(buffer, buffer_length, "0x%08X", address);
+    } else if (with_offset) {
+        kformat(
+            buffer, buffer_length, "%s+0x%X",
+            profiler_symbols[symbol].name,
+            address - profiler_symbols[symbol].address);
+    } else {
+        kformat(buffer, buffer_length, "%s", profiler_symbols[symbol].name);
+    }
+}
+
+static void profiler_print_entry(
+    struct profiler_entry* entry,
+    unsigned with_offset) {
+    char line[128];
+    char name[64];
+    // Keeps the arithmetic in 32 bits, it avoids a call to __udivdi3 for every
+    // line of the report
+    uint32_t permille = profiler_samples < UINT32_MAX / 1000
+        ? entry->count * 1000 / profiler_samples
+        : entry->count / (profiler_samples / 1000);
+
+    profiler_format_symbol(entry->address, with_offset, name, sizeof(name));
+
+    size_t length = kformat(
+        line, sizeof(line), "%3u.%u%% %8u  0x%08X  %s\n",
+        permille / 10, permille % 10,
+        entry->count,
+        entry->address,
+        name);
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+}
+
+// Prints the flat profile, the samples aggregated per function, followed by
+// the hottest addresses
+void profiler_report() {
+    char line[128];
+    unsigned functions_count = 0;
+    size_t length;
+
+    length = kformat(
+        line, sizeof(line), "PROFILE: %u samples, %u dropped, %u symbols\n",
+        profiler_samples, profiler_dropped, profiler_symbols_count);
+    console_write(CONSOLE_STREAM_TEXT, line, length);
+
+    if (profiler_samples == 0) {
+        return;
+    }
+
+    for (unsigned i = 0; i < PROFILER_HISTOGRAM_SIZE; i++) {
+        struct profiler_entry* entry = &profiler_histogram[i];
+        if (entry->count == 0) {
+            continue;
+        }
+
+        int symbol = profiler_find_symbol(entry->address);
+        uint32_t function = symbol < 0 ? entry->address : profiler_symbols[symbol].address;
+
+        unsigned j;
+        for (j = 0; j < functions_count; j++) {
+            if (profiler_functions[j].address == function) {
+                profiler_functions[j].count += entry->count;
+                break;
+            }
+        }
+
+        if (j == functions_count) {
+            profiler_functions[functions_count].address = function;
+            profiler_functions[functions_count].count = entry->count;
+            functions_count++;
+        }
+    }
+
+    console_writestring("FLAT PROFILE (FUNCTIONS):\n");
+    for (unsigned i = 0; i < PROFILER_TOP_FUNCTIONS && i < functions_count; i++) {
+        struct profiler_entry top = profiler_take_top(profiler_functions, functions_count);
+        profiler_print_entry(&top, 0);
+    }
+
+    console_writestring("FLAT PROFILE (ADDRESSES):\n");
+    for (unsigned i = 0; i < PROFILER_TOP_ADDRESSES; i++) {
+        struct profiler_entry top = profiler_take_top(profiler_histogram, PROFILER_HISTOGRAM_SIZE);
+        if (top.count == 0) {
+            break;
+        }
+        profiler_print_entry(&top, 1);
+    }
+}
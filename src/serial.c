@@ -86,3 +86,8 @@ void serial_writestring(
 	const char *data) {
     serial_write(port, data, str_len(data));
 }
+
+void serial_flush(
+	int port) {
+	while ((inb(port + 5) & 0x40) == 0);
+}
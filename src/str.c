@@ -31,6 +31,40 @@
 
 #include "str.h"
 
+// Two ascii digits for every value between 0 and 99, lets the decimal
+// conversion emit a pair of digits per division
+static const char str_dec_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Two uppercase hex digits for every byte value, the lowercase ones are the
+// same with bit 5 set as the digits already have it
+static const char str_hex_digit_pairs[513] =
+    "000102030405060708090A0B0C0D0E0F"
+    "101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F"
+    "303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F"
+    "505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F"
+    "707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F"
+    "909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+    "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+    "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
 size_t str_len(
     const char* str) {
 	size_t len = 0;
@@ -40,6 +74,36 @@ size_t str_len(
 	return len;
 }
 
+int str_ncmp(
+    const char* str1,
+    const char* str2,
+    size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (str1[i] != str2[i]) {
+            return (unsigned char)str1[i] - (unsigned char)str2[i];
+        }
+
+        if (str1[i] == 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// Parses up to length decimal digits, stops at the first non digit character
+uint64_t str_decstr_to_uint64(
+    const char* str,
+    size_t length) {
+    uint64_t number = 0;
+
+    for (size_t i = 0; i < length && str[i] >= '0' && str[i] <= '9'; i++) {
+        number = number * 10 + (str[i] - '0');
+    }
+
+    return number;
+}
+
 unsigned str_uint64_to_decstr_len(
     uint64_t number) {
     static uint8_t maxdigits[65] = {
@@ -80,22 +144,144 @@ char* str_uint64_to_decstr(
     number_str_length = *number_length = str_uint64_to_decstr_len(number);
 
     if (number_str_length > buffer_length) {
-        number_str_length = buffer_length;
+        return NULL;
     }
 
-    if (number_str_length == 0) {
-        return NULL;
+    str_uint64_to_decstr_fixed(number, number_str_length, buffer);
+
+    return buffer;
+}
+
+// Writes exactly digits characters, digits must be the value returned by
+// str_uint64_to_decstr_len, the buffer is not NUL terminated
+void str_uint64_to_decstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    char* buffer) {
+    char* pointer = buffer + digits;
+
+    // 64 bit divisions are expensive on i386, only use them while the number
+    // doesn't fit in 32 bits
+    while (number > UINT32_MAX) {
+        uint64_t quotient = number / 100U;
+        unsigned pair = (unsigned)(number - quotient * 100U);
+        pointer -= 2;
+        pointer[0] = str_dec_digit_pairs[pair * 2];
+        pointer[1] = str_dec_digit_pairs[pair * 2 + 1];
+        number = quotient;
     }
 
-    do {
-        buffer[number_str_length - 1] = (char)((number % 10U) + '0');
-    } while(number_str_length-- > 0 && (number /= 10U) > 0);
+    uint32_t number32 = (uint32_t)number;
+    while (number32 >= 100U) {
+        unsigned pair = number32 % 100U;
+        number32 /= 100U;
+        pointer -= 2;
+        pointer[0] = str_dec_digit_pairs[pair * 2];
+        pointer[1] = str_dec_digit_pairs[pair * 2 + 1];
+    }
 
-    if (number_str_length == 0 && number > 0) {
-        return NULL;
+    if (number32 >= 10U) {
+        pointer -= 2;
+        pointer[0] = str_dec_digit_pairs[number32 * 2];
+        pointer[1] = str_dec_digit_pairs[number32 * 2 + 1];
+    } else {
+        *--pointer = (char)('0' + number32);
     }
+}
 
-    return buffer;
+unsigned str_uint64_to_hexstr_len(
+    uint64_t number) {
+    if (number == 0) {
+        return 1;
+    }
+
+    return (sizeof(number) * 8 - __builtin_clzll(number) + 3) / 4;
+}
+
+// Converts the 8 nibbles of a 32 bit value in parallel: the nibbles are spread
+// one per byte, the bytes holding a value above 9 are detected by adding 6 and
+// checking the carry into the high nibble and then everything is shifted into
+// the ascii range at once. The most significant nibble ends up in the lowest
+// byte so the result can be stored straight into the buffer.
+static inline uint64_t str_uint32_to_hex_swar(
+    uint32_t number,
+    unsigned uppercase) {
+    uint64_t x = number;
+
+    x = ((x & 0xFFFF0000ULL) << 16) | (x & 0x0000FFFFULL);
+    x = ((x & 0x0000FF000000FF00ULL) << 8) | (x & 0x000000FF000000FFULL);
+    x = ((x & 0x00F000F000F000F0ULL) << 4) | (x & 0x000F000F000F000FULL);
+
+    uint64_t letters = ((x + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL;
+    x += 0x3030303030303030ULL + letters * (uppercase ? 7 : 39);
+
+    return __builtin_bswap64(x);
+}
+
+// Converts 8 digits or more through the SWAR conversion, kept out of line so
+// the short widths don't pay for its register setup
+__attribute__((noinline)) static void str_uint64_to_hexstr_swar(
+    uint64_t number,
+    unsigned digits,
+    unsigned uppercase,
+    char* buffer) {
+    uint64_t converted[2];
+
+    while (digits > 16) {
+        *buffer++ = '0';
+        digits--;
+    }
+
+    // The full widths are stored with whole word writes
+    if (digits == 8) {
+        converted[0] = str_uint32_to_hex_swar((uint32_t)number, uppercase);
+        __builtin_memcpy(buffer, converted, 8);
+        return;
+    }
+
+    converted[0] = str_uint32_to_hex_swar((uint32_t)(number >> 32), uppercase);
+    converted[1] = str_uint32_to_hex_swar((uint32_t)number, uppercase);
+
+    if (digits == 16) {
+        __builtin_memcpy(buffer, converted, 16);
+        return;
+    }
+
+    const char* source = (const char*)converted + 16 - digits;
+    for (unsigned i = 0; i < digits; i++) {
+        buffer[i] = source[i];
+    }
+}
+
+// Writes exactly digits characters holding the lowest digits nibbles of the
+// number, zero padded, the buffer is not NUL terminated
+void str_uint64_to_hexstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    unsigned uppercase,
+    char* buffer) {
+    if (digits >= 8) {
+        str_uint64_to_hexstr_swar(number, digits, uppercase, buffer);
+        return;
+    }
+
+    // Most of the values printed are 2 or 4 digits wide, they take one lookup
+    // per pair of digits in the table, 1 and 2 lookups
+    char case_bit = uppercase ? 0 : 0x20;
+    uint32_t number32 = (uint32_t)number;
+    char* pointer = buffer + digits;
+
+    while (pointer - buffer >= 2) {
+        const char* pair = &str_hex_digit_pairs[(number32 & 0xFF) * 2];
+        pointer -= 2;
+        pointer[0] = pair[0] | case_bit;
+        pointer[1] = pair[1] | case_bit;
+        number32 >>= 8;
+    }
+
+    if (pointer != buffer) {
+        *--pointer = str_hex_digit_pairs[(number32 & 0xF) * 2 + 1] | case_bit;
+    }
 }
 
 char* str_uint64_to_hexstr(
@@ -111,18 +297,7 @@ char* str_uint64_to_hexstr(
         length = buffer_length;
     }
 
-    int index;
-    for(index = length - 1; index >= 0; index--) {
-        int digit = number & 0xF;
-
-        if (digit <= 9) {
-            buffer[index] = '0' + digit;
-        } else {
-            buffer[index] = 'A' + (digit - 10);
-        }
-        
-        number >>= 4;
-    }
+    str_uint64_to_hexstr_fixed(number, length, 1, buffer);
 
     return buffer;
 }
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Runs the fleet inventory tool on the logs of tests/fleetinv and compares its
+# output with tests/fleetinv/expected.txt. node01.log is the serial capture of
+# the same configuration as node02.log, with CRLF line endings, a bracketed
+# timestamp in front of every line and a BAR line running into a record.
+#   tests/fleetinv_test.sh build/fleetinv
+
+fleetinv=$1
+logs=tests/fleetinv
+
+for command in summary groups devices "has 8086:100E" "lacks 8086:100E"; do
+    echo "== $command"
+    $fleetinv $command $logs/node01.log $logs/node02.log $logs/node03.log
+done | diff -u $logs/expected.txt - || exit 1
+
+echo "fleetinv_test: passed"
@@ -0,0 +1,245 @@
+// Host unit test of kformat and of the str.c integer conversions, everything
+// is checked against the snprintf of the host C library:
+//   make test
+// The kernel sources are built as they are with the host compiler, pass
+// TEST_CFLAGS=-m32 when a 32 bit libc is installed to exercise the i386 code
+// paths of the 64 bit divisions.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "str.h"
+#include "kformat.h"
+
+#define KFORMAT_TEST_RANDOM_CASES 1000000
+#define KFORMAT_TEST_MAX_FAILURES 20
+
+uint64_t kformat_test_state = 0x9E3779B97F4A7C15ULL;
+unsigned long kformat_test_cases = 0;
+unsigned long kformat_test_failures = 0;
+
+static uint64_t kformat_test_random() {
+    uint64_t x = kformat_test_state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return kformat_test_state = x;
+}
+
+// Random values of a random bit length, so every number of digits shows up as
+// often as the others
+static uint64_t kformat_test_random_number() {
+    unsigned bits = kformat_test_random() % 65;
+    uint64_t number = kformat_test_random();
+
+    return bits == 64 ? number : number & ((1ULL << bits) - 1);
+}
+
+static void kformat_test_check(
+    const char* what,
+    const char* expected,
+    size_t expected_length,
+    const char* actual,
+    size_t actual_length) {
+    kformat_test_cases++;
+
+    if (expected_length == actual_length && memcmp(expected, actual, actual_length) == 0) {
+        return;
+    }
+
+    if (++kformat_test_failures <= KFORMAT_TEST_MAX_FAILURES) {
+        printf("FAIL %s: expected \"%.*s\" (%zu), got \"%.*s\" (%zu)\n",
+            what,
+            (int)expected_length, expected, expected_length,
+            (int)actual_length, actual, actual_length);
+    }
+}
+
+static void kformat_test_decstr(
+    uint64_t number) {
+    char expected[32];
+    char actual[32];
+    char what[64];
+
+    int expected_length = snprintf(expected, sizeof(expected), "%llu", (unsigned long long)number);
+    unsigned digits = str_uint64_to_decstr_len(number);
+    str_uint64_to_decstr_fixed(number, digits, actual);
+
+    snprintf(what, sizeof(what), "str_uint64_to_decstr_fixed(%llu)", (unsigned long long)number);
+    kformat_test_check(what, expected, expected_length, actual, digits);
+}
+
+static void kformat_test_hexstr(
+    uint64_t number,
+    unsigned digits,
+    unsigned uppercase) {
+    char padded[32];
+    char actual[32];
+    char what[64];
+
+    // The lowest digits nibbles, zero padded
+    snprintf(padded, sizeof(padded), uppercase ? "%020llX" : "%020llx", (unsigned long long)number);
+    str_uint64_to_hexstr_fixed(number, digits, uppercase, actual);
+
+    snprintf(what, sizeof(what), "str_uint64_to_hexstr_fixed(0x%llx, %u, %u)",
+        (unsigned long long)number, digits, uppercase);
+    kformat_test_check(what, padded + 20 - digits, digits, actual, digits);
+
+    // The lengths are compared as text to reuse the same report
+    char expected_length[8];
+    char actual_length[8];
+    int expected_digits = snprintf(padded, sizeof(padded), "%llx", (unsigned long long)number);
+    int expected_length_length = snprintf(
+        expected_length, sizeof(expected_length), "%d", expected_digits);
+    int actual_length_length = snprintf(
+        actual_length, sizeof(actual_length), "%u", str_uint64_to_hexstr_len(number));
+
+    snprintf(what, sizeof(what), "str_uint64_to_hexstr_len(0x%llx)", (unsigned long long)number);
+    kformat_test_check(
+        what, expected_length, expected_length_length, actual_length, actual_length_length);
+}
+
+// Formats the same arguments with snprintf and kformat into a buffer of the
+// given size, kformat returns the length actually written
+static void kformat_test_format(
+    size_t buffer_length,
+    const char* format,
+    ...) {
+    char expected[128];
+    char actual[128];
+    char what[96];
+    va_list args;
+    va_list args_copy;
+
+    memset(expected, 'E', sizeof(expected));
+    memset(actual, 'A', sizeof(actual));
+
+    va_start(args, format);
+    va_copy(args_copy, args);
+    int full_length = vsnprintf(expected, buffer_length, format, args);
+    size_t actual_length = kformat_va(actual, buffer_length, format, args_copy);
+    va_end(args_copy);
+    va_end(args);
+
+    size_t expected_length = buffer_length == 0
+        ? 0
+        : ((size_t)full_length < buffer_length ? (size_t)full_length : buffer_length - 1);
+
+    snprintf(what, sizeof(what), "kformat(%zu, \"%s\")", buffer_length, format);
+
+    // The NUL terminator and the untouched bytes after it are compared too
+    kformat_test_check(
+        what,
+        expected, buffer_length > 0 ? expected_length + 1 : 0,
+        actual, buffer_length > 0 ? actual_length + 1 : actual_length);
+}
+
+static void kformat_test_random_integer_format() {
+    static const char* const flags[] = { "", "-", "0" };
+    static const char* const lengths[] = { "", "l", "ll" };
+    static const char conversions[] = { 'd', 'u', 'x', 'X' };
+    char format[32];
+
+    const char* flag = flags[kformat_test_random() % 3];
+    unsigned longs = kformat_test_random() % 3;
+    char conversion = conversions[kformat_test_random() % 4];
+    unsigned width = kformat_test_random() % 3 == 0 ? 0 : kformat_test_random() % 25;
+    size_t buffer_length = kformat_test_random() % 4 == 0 ? kformat_test_random() % 24 : 128;
+    uint64_t number = kformat_test_random_number();
+
+    if (width == 0) {
+        snprintf(format, sizeof(format), "<%%%s%s%c>", flag, lengths[longs], conversion);
+    } else {
+        snprintf(format, sizeof(format), "<%%%s%u%s%c>", flag, width, lengths[longs], conversion);
+    }
+
+    switch (longs) {
+        case 0:
+            kformat_test_format(buffer_length, format, (unsigned int)number);
+            break;
+
+        case 1:
+            kformat_test_format(buffer_length, format, (unsigned long)number);
+            break;
+
+        default:
+            kformat_test_format(buffer_length, format, (unsigned long long)number);
+            break;
+    }
+}
+
+static void kformat_test_fixed_formats() {
+    kformat_test_format(128, "");
+    kformat_test_format(128, "plain text");
+    kformat_test_format(128, "100%%");
+    kformat_test_format(128, "%c%c%c", 'a', 'B', '0');
+    kformat_test_format(128, "[%s] [%10s] [%-10s]", "abc", "abc", "abc");
+    kformat_test_format(128, "[%*s] [%-*s]", 6, "ab", 6, "ab");
+    kformat_test_format(128, "[%*u] [%-*x] [%0*X]", 7, 42U, 7, 42U, 7, 42U);
+    kformat_test_format(128, "%d %d %d", 0, -1, INT32_MIN);
+    kformat_test_format(128, "%lld %lld", (long long)INT64_MIN, (long long)INT64_MAX);
+    kformat_test_format(128, "%05d %-5d| %5d", -42, -42, -42);
+    kformat_test_format(128, "%llu %llx", (unsigned long long)UINT64_MAX, (unsigned long long)UINT64_MAX);
+    kformat_test_format(8, "%s", "truncated string");
+    kformat_test_format(1, "%u", 12345U);
+    kformat_test_format(0, "%u", 12345U);
+    kformat_test_format(
+        128,
+        "ID: %04X:%04X, Class: 0x%02X, SubClass: 0x%02X, Rev: %u\n",
+        0x8086U, 0x10D3U, 0x02U, 0x00U, 3U);
+
+    // %B has no printf counterpart
+    for (unsigned bus = 0; bus < 256; bus += 17) {
+        for (unsigned device = 0; device < 32; device += 3) {
+            for (unsigned function = 0; function < 8; function++) {
+                char expected[16];
+                char actual[16];
+
+                int expected_length = snprintf(
+                    expected, sizeof(expected), "%02X:%02X:%02X", bus, device, function);
+                size_t actual_length = kformat(actual, sizeof(actual), "%B", bus, device, function);
+                kformat_test_check("kformat(%B)", expected, expected_length, actual, actual_length);
+            }
+        }
+    }
+}
+
+int main() {
+    uint64_t power = 1;
+
+    // Edges of every decimal and hexadecimal length
+    kformat_test_decstr(0);
+    kformat_test_decstr(UINT64_MAX);
+    for (unsigned i = 0; i < 20; i++) {
+        kformat_test_decstr(power - 1);
+        kformat_test_decstr(power);
+        kformat_test_decstr(power + 1);
+        power *= 10;
+    }
+
+    for (unsigned bits = 0; bits < 64; bits++) {
+        for (unsigned digits = 1; digits <= 20; digits++) {
+            kformat_test_hexstr((1ULL << bits) - 1, digits, digits & 1);
+            kformat_test_hexstr(1ULL << bits, digits, digits & 1);
+        }
+    }
+
+    kformat_test_fixed_formats();
+
+    for (unsigned long i = 0; i < KFORMAT_TEST_RANDOM_CASES; i++) {
+        uint64_t number = kformat_test_random_number();
+
+        kformat_test_decstr(number);
+        kformat_test_hexstr(number, 1 + kformat_test_random() % 20, kformat_test_random() & 1);
+        kformat_test_random_integer_format();
+    }
+
+    printf("kformat_test: %lu cases, %lu failures\n", kformat_test_cases, kformat_test_failures);
+
+    return kformat_test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+// Host benchmark of the str.c integer conversions against the per-digit and
+// per-nibble loops they replaced, and of kformat against snprintf on the line
+// printed for every PCI function:
+//   make test
+// Pass TEST_CFLAGS=-m32 when a 32 bit libc is installed to time the i386 code
+// paths of the 64 bit divisions.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "str.h"
+#include "kformat.h"
+
+#define STR_BENCH_VALUES 4096
+#define STR_BENCH_ROUNDS 2000
+
+uint64_t str_bench_values[STR_BENCH_VALUES];
+unsigned str_bench_lengths[STR_BENCH_VALUES];
+volatile uint64_t str_bench_sink = 0;
+
+// The conversion str_uint64_to_decstr used to do, one division by 10 per digit,
+// kept out of line like the str.c functions it's compared with
+__attribute__((noinline)) static void str_bench_decstr_per_digit(
+    uint64_t number,
+    unsigned digits,
+    char* buffer) {
+    do {
+        buffer[--digits] = (char)((number % 10U) + '0');
+        number /= 10U;
+    } while (digits > 0);
+}
+
+// The conversion str_uint64_to_hexstr used to do, one branch per nibble
+__attribute__((noinline)) static void str_bench_hexstr_per_nibble(
+    uint64_t number,
+    unsigned digits,
+    char* buffer) {
+    for (int index = digits - 1; index >= 0; index--) {
+        int digit = number & 0xF;
+
+        if (digit <= 9) {
+            buffer[index] = '0' + digit;
+        } else {
+            buffer[index] = 'A' + (digit - 10);
+        }
+
+        number >>= 4;
+    }
+}
+
+static double str_bench_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void str_bench_report(
+    const char* name,
+    double seconds,
+    double baseline) {
+    double conversions = (double)STR_BENCH_VALUES * STR_BENCH_ROUNDS;
+
+    if (baseline > 0) {
+        printf("  %-28s %7.2f ns/op  %5.2fx\n", name, seconds / conversions * 1e9, baseline / seconds);
+    } else {
+        printf("  %-28s %7.2f ns/op\n", name, seconds / conversions * 1e9);
+    }
+}
+
+static double str_bench_decimal(
+    void (*convert)(uint64_t, unsigned, char*)) {
+    char buffer[24];
+    uint64_t sum = 0;
+    double start = str_bench_now();
+
+    for (unsigned round = 0; round < STR_BENCH_ROUNDS; round++) {
+        for (unsigned i = 0; i < STR_BENCH_VALUES; i++) {
+            convert(str_bench_values[i], str_bench_lengths[i], buffer);
+            sum += buffer[0];
+        }
+    }
+
+    str_bench_sink += sum;
+
+    return str_bench_now() - start;
+}
+
+static void str_bench_decstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    char* buffer) {
+    str_uint64_to_decstr_fixed(number, digits, buffer);
+}
+
+static double str_bench_hexadecimal(
+    void (*convert)(uint64_t, unsigned, char*),
+    unsigned digits) {
+    char buffer[24];
+    uint64_t sum = 0;
+    double start = str_bench_now();
+
+    for (unsigned round = 0; round < STR_BENCH_ROUNDS; round++) {
+        for (unsigned i = 0; i < STR_BENCH_VALUES; i++) {
+            convert(str_bench_values[i], digits, buffer);
+            sum += buffer[0];
+        }
+    }
+
+    str_bench_sink += sum;
+
+    return str_bench_now() - start;
+}
+
+static void str_bench_hexstr_fixed(
+    uint64_t number,
+    unsigned digits,
+    char* buffer) {
+    str_uint64_to_hexstr_fixed(number, digits, 1, buffer);
+}
+
+static double str_bench_line(
+    int use_kformat) {
+    char line[96];
+    uint64_t sum = 0;
+    double start = str_bench_now();
+
+    for (unsigned round = 0; round < STR_BENCH_ROUNDS; round++) {
+        for (unsigned i = 0; i < STR_BENCH_VALUES; i++) {
+            uint32_t value = (uint32_t)str_bench_values[i];
+            unsigned bus = value & 0xFF;
+            unsigned device = (value >> 8) & 0x1F;
+            unsigned function = (value >> 13) & 0x7;
+
+            if (use_kformat) {
+                sum += kformat(
+                    line, sizeof(line),
+                    "[%B] ID: %04X:%04X, Class: 0x%02X, SubClass: 0x%02X, Rev: %u\n",
+                    bus, device, function,
+                    value >> 16, value & 0xFFFF, bus, device, function);
+            } else {
+                sum += snprintf(
+                    line, sizeof(line),
+                    "[%02X:%02X:%02X] ID: %04X:%04X, Class: 0x%02X, SubClass: 0x%02X, Rev: %u\n",
+                    bus, device, function,
+                    value >> 16, value & 0xFFFF, bus, device, function);
+            }
+        }
+    }
+
+    str_bench_sink += sum;
+
+    return str_bench_now() - start;
+}
+
+int main() {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+    // Values of a random bit length, so every number of digits shows up
+    for (unsigned i = 0; i < STR_BENCH_VALUES; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        unsigned bits = 1 + state % 64;
+        str_bench_values[i] = bits == 64 ? state : state & ((1ULL << bits) - 1);
+        str_bench_lengths[i] = str_uint64_to_decstr_len(str_bench_values[i]);
+    }
+
+    printf("str_bench: %u conversions per case\n", STR_BENCH_VALUES * STR_BENCH_ROUNDS);
+
+    double baseline = str_bench_decimal(str_bench_decstr_per_digit);
+    str_bench_report("decimal, per digit", baseline, 0);
+    str_bench_report("decimal, digit pairs", str_bench_decimal(str_bench_decstr_fixed), baseline);
+
+    baseline = str_bench_hexadecimal(str_bench_hexstr_per_nibble, 16);
+    str_bench_report("hex 16 digits, per nibble", baseline, 0);
+    str_bench_report("hex 16 digits, SWAR", str_bench_hexadecimal(str_bench_hexstr_fixed, 16), baseline);
+
+    baseline = str_bench_hexadecimal(str_bench_hexstr_per_nibble, 8);
+    str_bench_report("hex 8 digits, per nibble", baseline, 0);
+    str_bench_report("hex 8 digits, SWAR", str_bench_hexadecimal(str_bench_hexstr_fixed, 8), baseline);
+
+    baseline = str_bench_hexadecimal(str_bench_hexstr_per_nibble, 2);
+    str_bench_report("hex 2 digits, per nibble", baseline, 0);
+    str_bench_report("hex 2 digits, digit pairs", str_bench_hexadecimal(str_bench_hexstr_fixed, 2), baseline);
+
+    baseline = str_bench_hexadecimal(str_bench_hexstr_per_nibble, 4);
+    str_bench_report("hex 4 digits, per nibble", baseline, 0);
+    str_bench_report("hex 4 digits, digit pairs", str_bench_hexadecimal(str_bench_hexstr_fixed, 4), baseline);
+
+    baseline = str_bench_line(0);
+    str_bench_report("PCI line, snprintf", baseline, 0);
+    str_bench_report("PCI line, kformat", str_bench_line(1), baseline);
+
+    return 0;
+}
@@ -0,0 +1,629 @@
+// Host side fleet inventory aggregator for the scan outputs.
+//
+// Every log is the serial output of one host, the host name is the file name
+// without directory and extension. The lines printed by pci_print_dev_info
+//   [BB:DD:FF] ID: VVVV:DDDD, Class: 0xCC, SubClass: 0xSS, Rev: N
+// are parsed in place from the memory mapped file, everything else is
+// skipped. The set of functions of a host is its configuration, identical
+// configurations are deduplicated through their content hash and the device
+// index maps every vendor:device pair to the configurations containing it.
+//
+// Usage: fleetinv <command> [argument] [log...]
+//   summary          hosts, distinct configurations and devices
+//   groups           hosts grouped by identical configuration (topology)
+//   devices          every device with the number of hosts having it
+//   has VVVV:DDDD    hosts having the device
+//   lacks VVVV:DDDD  hosts lacking the device
+// The paths of the logs are read from stdin, one per line, when none is
+// passed on the command line.
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FLEETINV_LINE_PREFIX_LENGTH 60
+
+struct fleetinv_record {
+    // bus:device.function << 48 | vendor << 32 | device << 16 | class << 8 | subclass
+    uint64_t key;
+    uint8_t rev;
+};
+
+struct fleetinv_config {
+    uint64_t hash;
+    struct fleetinv_record* records;
+    size_t records_count;
+    uint32_t* hosts;
+    size_t hosts_count;
+    size_t hosts_capacity;
+};
+
+struct fleetinv_device {
+    uint32_t id;
+    uint32_t* configs;
+    size_t configs_count;
+    size_t configs_capacity;
+};
+
+struct fleetinv {
+    char** hosts;
+    size_t hosts_count;
+    size_t hosts_capacity;
+
+    struct fleetinv_config* configs;
+    size_t configs_count;
+    size_t configs_capacity;
+
+    // Open addressing tables, hash of the configuration -> configuration
+    // index + 1 and device id -> device index + 1
+    uint32_t* config_table;
+    size_t config_table_size;
+    struct fleetinv_device* devices;
+    size_t devices_count;
+    size_t devices_capacity;
+    uint32_t* device_table;
+    size_t device_table_size;
+
+    uint64_t lines;
+};
+
+static int8_t fleetinv_hex_values[256];
+
+static void* fleetinv_alloc(
+    void* pointer,
+    size_t count,
+    size_t size) {
+    pointer = realloc(pointer, count * size);
+    if (pointer == NULL && count > 0) {
+        fprintf(stderr, "fleetinv: out of memory\n");
+        exit(1);
+    }
+
+    return pointer;
+}
+
+#define FLEETINV_GROW(array, count, capacity) \
+    do { \
+        if ((count) == (capacity)) { \
+            (capacity) = (capacity) == 0 ? 16 : (capacity) * 2; \
+            (array) = fleetinv_alloc((array), (capacity), sizeof(*(array))); \
+        } \
+    } while (0)
+
+static void fleetinv_init_hex_values() {
+    memset(fleetinv_hex_values, -1, sizeof(fleetinv_hex_values));
+    for (int i = 0; i < 10; i++) {
+        fleetinv_hex_values['0' + i] = i;
+    }
+    for (int i = 0; i < 6; i++) {
+        fleetinv_hex_values['A' + i] = 10 + i;
+        fleetinv_hex_values['a' + i] = 10 + i;
+    }
+}
+
+// Parses count hex digits, returns -1 on any non hex digit
+static inline int64_t fleetinv_parse_hex(
+    const char* data,
+    unsigned count) {
+    int64_t value = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        int8_t digit = fleetinv_hex_values[(unsigned char)data[i]];
+        if (digit < 0) {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+
+    return value;
+}
+
+static inline int fleetinv_match(
+    const char* data,
+    const char* literal,
+    size_t length) {
+    return memcmp(data, literal, length) == 0;
+}
+
+// The format is fixed width up to the revision, every field is checked at its
+// offset without scanning the line
+static int fleetinv_parse_line(
+    const char* line,
+    const char* end,
+    struct fleetinv_record* record) {
+    if (end - line < FLEETINV_LINE_PREFIX_LENGTH + 1 ||
+        line[0] != '[' || line[3] != ':' || line[6] != ':' ||
+        !fleetinv_match(line + 9, "] ID: ", 6) ||
+        line[19] != ':' ||
+        !fleetinv_match(line + 24, ", Class: 0x", 11) ||
+        !fleetinv_match(line + 37, ", SubClass: 0x", 14) ||
+        !fleetinv_match(line + 53, ", Rev: ", 7)) {
+        return 0;
+    }
+
+    int64_t bus = fleetinv_parse_hex(line + 1, 2);
+    int64_t device = fleetinv_parse_hex(line + 4, 2);
+    int64_t function = fleetinv_parse_hex(line + 7, 2);
+    int64_t vendor_id = fleetinv_parse_hex(line + 15, 4);
+    int64_t device_id = fleetinv_parse_hex(line + 20, 4);
+    int64_t class = fleetinv_parse_hex(line + 35, 2);
+    int64_t subclass = fleetinv_parse_hex(line + 51, 2);
+
+    if (bus < 0 || device < 0 || function < 0 || vendor_id < 0 || device_id < 0 ||
+        class < 0 || subclass < 0) {
+        return 0;
+    }
+
+    unsigned rev = 0;
+    const char* digit = line + FLEETINV_LINE_PREFIX_LENGTH;
+    while (digit < end && *digit >= '0' && *digit <= '9') {
+        rev = rev * 10 + (*digit++ - '0');
+    }
+
+    uint64_t bdf = ((uint64_t)bus << 8) | ((uint64_t)device << 3) | (uint64_t)function;
+    record->key = (bdf << 48) | ((uint64_t)vendor_id << 32) | ((uint64_t)device_id << 16) |
+        ((uint64_t)class << 8) | (uint64_t)subclass;
+    record->rev = (uint8_t)rev;
+
+    return 1;
+}
+
+static int fleetinv_record_compare(
+    const void* a,
+    const void* b) {
+    const struct fleetinv_record* record_a = a;
+    const struct fleetinv_record* record_b = b;
+
+    if (record_a->key != record_b->key) {
+        return record_a->key < record_b->key ? -1 : 1;
+    }
+
+    return (int)record_a->rev - (int)record_b->rev;
+}
+
+static uint64_t fleetinv_hash_records(
+    const struct fleetinv_record* records,
+    size_t count) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t values[2] = { records[i].key, records[i].rev };
+        const uint8_t* bytes = (const uint8_t*)values;
+        for (size_t j = 0; j < sizeof(values); j++) {
+            hash = (hash ^ bytes[j]) * 0x100000001B3ULL;
+        }
+    }
+
+    return hash;
+}
+
+static int fleetinv_records_equal(
+    const struct fleetinv_record* a,
+    const struct fleetinv_record* b,
+    size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (a[i].key != b[i].key || a[i].rev != b[i].rev) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static inline size_t fleetinv_mix(
+    uint64_t value,
+    size_t table_size) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    return (size_t)value & (table_size - 1);
+}
+
+static void fleetinv_config_table_rehash(
+    struct fleetinv* inventory) {
+    size_t size = inventory->config_table_size == 0 ? 1024 : inventory->config_table_size * 2;
+    uint32_t* table = calloc(size, sizeof(*table));
+    if (table == NULL) {
+        fprintf(stderr, "fleetinv: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < inventory->configs_count; i++) {
+        size_t slot = fleetinv_mix(inventory->configs[i].hash, size);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        table[slot] = (uint32_t)i + 1;
+    }
+
+    free(inventory->config_table);
+    inventory->config_table = table;
+    inventory->config_table_size = size;
+}
+
+static void fleetinv_device_table_rehash(
+    struct fleetinv* inventory) {
+    size_t size = inventory->device_table_size == 0 ? 1024 : inventory->device_table_size * 2;
+    uint32_t* table = calloc(size, sizeof(*table));
+    if (table == NULL) {
+        fprintf(stderr, "fleetinv: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < inventory->devices_count; i++) {
+        size_t slot = fleetinv_mix(inventory->devices[i].id, size);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        table[slot] = (uint32_t)i + 1;
+    }
+
+    free(inventory->device_table);
+    inventory->device_table = table;
+    inventory->device_table_size = size;
+}
+
+static struct fleetinv_device* fleetinv_find_device(
+    struct fleetinv* inventory,
+    uint32_t id,
+    int create) {
+    if (inventory->device_table_size == 0) {
+        if (!create) {
+            return NULL;
+        }
+        fleetinv_device_table_rehash(inventory);
+    }
+
+    size_t slot = fleetinv_mix(id, inventory->device_table_size);
+    while (inventory->device_table[slot] != 0) {
+        struct fleetinv_device* device = &inventory->devices[inventory->device_table[slot] - 1];
+        if (device->id == id) {
+            return device;
+        }
+        slot = (slot + 1) & (inventory->device_table_size - 1);
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    FLEETINV_GROW(inventory->devices, inventory->devices_count, inventory->devices_capacity);
+    struct fleetinv_device* device = &inventory->devices[inventory->devices_count++];
+    memset(device, 0, sizeof(*device));
+    device->id = id;
+    inventory->device_table[slot] = (uint32_t)inventory->devices_count;
+
+    if (inventory->devices_count * 2 > inventory->device_table_size) {
+        fleetinv_device_table_rehash(inventory);
+    }
+
+    return device;
+}
+
+// Returns the index of the configuration holding exactly these records,
+// creating it if needed, the records are copied only for new configurations
+static uint32_t fleetinv_intern_config(
+    struct fleetinv* inventory,
+    const struct fleetinv_record* records,
+    size_t count) {
+    uint64_t hash = fleetinv_hash_records(records, count);
+
+    if (inventory->config_table_size == 0) {
+        fleetinv_config_table_rehash(inventory);
+    }
+
+    size_t slot = fleetinv_mix(hash, inventory->config_table_size);
+    while (inventory->config_table[slot] != 0) {
+        uint32_t index = inventory->config_table[slot] - 1;
+        struct fleetinv_config* config = &inventory->configs[index];
+        if (config->hash == hash && config->records_count == count &&
+            fleetinv_records_equal(config->records, records, count)) {
+            return index;
+        }
+        slot = (slot + 1) & (inventory->config_table_size - 1);
+    }
+
+    FLEETINV_GROW(inventory->configs, inventory->configs_count, inventory->configs_capacity);
+    uint32_t index = (uint32_t)inventory->configs_count++;
+    struct fleetinv_config* config = &inventory->configs[index];
+    memset(config, 0, sizeof(*config));
+    config->hash = hash;
+    config->records_count = count;
+    config->records = fleetinv_alloc(NULL, count, sizeof(*records));
+    memcpy(config->records, records, count * sizeof(*records));
+    inventory->config_table[slot] = index + 1;
+
+    // Index the distinct devices of the new configuration, the records are
+    // sorted by slot so the same device can appear more than once
+    for (size_t i = 0; i < count; i++) {
+        uint32_t id = (uint32_t)(records[i].key >> 16);
+        struct fleetinv_device* device = fleetinv_find_device(inventory, id, 1);
+        if (device->configs_count > 0 && device->configs[device->configs_count - 1] == index) {
+            continue;
+        }
+        FLEETINV_GROW(device->configs, device->configs_count, device->configs_capacity);
+        device->configs[device->configs_count++] = index;
+    }
+
+    if (inventory->configs_count * 2 > inventory->config_table_size) {
+        fleetinv_config_table_rehash(inventory);
+    }
+
+    return index;
+}
+
+static char* fleetinv_host_name(
+    const char* path) {
+    const char* name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+
+    const char* extension = strrchr(name, '.');
+    size_t length = extension != NULL && extension != name
+        ? (size_t)(extension - name)
+        : strlen(name);
+
+    return strndup(name, length);
+}
+
+static int fleetinv_load(
+    struct fleetinv* inventory,
+    const char* path,
+    struct fleetinv_record** records,
+    size_t* records_capacity) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return 0;
+    }
+
+    size_t records_count = 0;
+    size_t size = (size_t)st.st_size;
+    const char* data = NULL;
+
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return 0;
+        }
+        madvise((void*)data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    const char* end = data + size;
+    for (const char* line = data; line < end;) {
+        const char* line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        inventory->lines++;
+
+        // Serial logs may carry a prefix (timestamps, carriage returns) that
+        // can hold brackets too, every '[' is tried until a record matches
+        struct fleetinv_record record;
+        for (const char* start = memchr(line, '[', line_end - line);
+            start != NULL;
+            start = memchr(start + 1, '[', line_end - start - 1)) {
+            if (fleetinv_parse_line(start, line_end, &record)) {
+                FLEETINV_GROW(*records, records_count, *records_capacity);
+                (*records)[records_count++] = record;
+                break;
+            }
+        }
+
+        line = line_end + 1;
+    }
+
+    if (size > 0) {
+        munmap((void*)data, size);
+    }
+
+    // A log holding more than one scan, e.g. after a reboot, contributes the
+    // union of the functions seen
+    qsort(*records, records_count, sizeof(**records), fleetinv_record_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < records_count; i++) {
+        if (unique == 0 || fleetinv_record_compare(&(*records)[unique - 1], &(*records)[i]) != 0) {
+            (*records)[unique++] = (*records)[i];
+        }
+    }
+
+    FLEETINV_GROW(inventory->hosts, inventory->hosts_count, inventory->hosts_capacity);
+    uint32_t host = (uint32_t)inventory->hosts_count;
+    inventory->hosts[inventory->hosts_count++] = fleetinv_host_name(path);
+
+    uint32_t index = fleetinv_intern_config(inventory, *records, unique);
+    struct fleetinv_config* config = &inventory->configs[index];
+    FLEETINV_GROW(config->hosts, config->hosts_count, config->hosts_capacity);
+    config->hosts[config->hosts_count++] = host;
+
+    return 1;
+}
+
+static int fleetinv_parse_device_id(
+    const char* text,
+    uint32_t* id) {
+    if (strlen(text) != 9 || text[4] != ':') {
+        return 0;
+    }
+
+    int64_t vendor_id = fleetinv_parse_hex(text, 4);
+    int64_t device_id = fleetinv_parse_hex(text + 5, 4);
+    if (vendor_id < 0 || device_id < 0) {
+        return 0;
+    }
+
+    *id = ((uint32_t)vendor_id << 16) | (uint32_t)device_id;
+    return 1;
+}
+
+static void fleetinv_print_hosts(
+    struct fleetinv* inventory,
+    const struct fleetinv_config* config) {
+    for (size_t i = 0; i < config->hosts_count; i++) {
+        printf("%s\n", inventory->hosts[config->hosts[i]]);
+    }
+}
+
+// Prints the hosts whose configuration contains (or lacks) the device, the
+// index is used to mark the matching configurations once
+static void fleetinv_query_device(
+    struct fleetinv* inventory,
+    uint32_t id,
+    int has) {
+    uint8_t* marked = calloc(inventory->configs_count + 1, 1);
+    struct fleetinv_device* device = fleetinv_find_device(inventory, id, 0);
+
+    if (device != NULL) {
+        for (size_t i = 0; i < device->configs_count; i++) {
+            marked[device->configs[i]] = 1;
+        }
+    }
+
+    for (size_t i = 0; i < inventory->configs_count; i++) {
+        if (marked[i] == has) {
+            fleetinv_print_hosts(inventory, &inventory->configs[i]);
+        }
+    }
+
+    free(marked);
+}
+
+static int fleetinv_config_compare_hosts(
+    const void* a,
+    const void* b) {
+    const struct fleetinv_config* config_a = *(const struct fleetinv_config* const*)a;
+    const struct fleetinv_config* config_b = *(const struct fleetinv_config* const*)b;
+
+    if (config_a->hosts_count != config_b->hosts_count) {
+        return config_a->hosts_count > config_b->hosts_count ? -1 : 1;
+    }
+
+    return config_a->hash < config_b->hash ? -1 : config_a->hash > config_b->hash;
+}
+
+static void fleetinv_print_groups(
+    struct fleetinv* inventory) {
+    const struct fleetinv_config** sorted =
+        fleetinv_alloc(NULL, inventory->configs_count, sizeof(*sorted));
+
+    for (size_t i = 0; i < inventory->configs_count; i++) {
+        sorted[i] = &inventory->configs[i];
+    }
+    qsort(sorted, inventory->configs_count, sizeof(*sorted), fleetinv_config_compare_hosts);
+
+    for (size_t i = 0; i < inventory->configs_count; i++) {
+        const struct fleetinv_config* config = sorted[i];
+        printf("config %016llx: %zu hosts, %zu functions:",
+            (unsigned long long)config->hash, config->hosts_count, config->records_count);
+        for (size_t j = 0; j < config->hosts_count; j++) {
+            printf(" %s", inventory->hosts[config->hosts[j]]);
+        }
+        printf("\n");
+    }
+
+    free(sorted);
+}
+
+static void fleetinv_print_devices(
+    struct fleetinv* inventory) {
+    for (size_t i = 0; i < inventory->devices_count; i++) {
+        const struct fleetinv_device* device = &inventory->devices[i];
+        size_t hosts = 0;
+        for (size_t j = 0; j < device->configs_count; j++) {
+            hosts += inventory->configs[device->configs[j]].hosts_count;
+        }
+        printf("%04X:%04X %zu\n", device->id >> 16, device->id & 0xFFFF, hosts);
+    }
+}
+
+static void fleetinv_usage() {
+    fprintf(stderr,
+        "usage: fleetinv summary|groups|devices [log...]\n"
+        "       fleetinv has|lacks VVVV:DDDD [log...]\n"
+        "the paths are read from stdin when no log is passed\n");
+    exit(2);
+}
+
+int main(
+    int argc,
+    char** argv) {
+    struct fleetinv inventory;
+    struct fleetinv_record* records = NULL;
+    size_t records_capacity = 0;
+    uint32_t device_id = 0;
+    int first_log = 2;
+
+    if (argc < 2) {
+        fleetinv_usage();
+    }
+
+    fleetinv_init_hex_values();
+
+    const char* command = argv[1];
+    if (strcmp(command, "has") == 0 || strcmp(command, "lacks") == 0) {
+        if (argc < 3 || !fleetinv_parse_device_id(argv[2], &device_id)) {
+            fleetinv_usage();
+        }
+        first_log = 3;
+    } else if (strcmp(command, "summary") != 0 &&
+        strcmp(command, "groups") != 0 &&
+        strcmp(command, "devices") != 0) {
+        fleetinv_usage();
+    }
+
+    memset(&inventory, 0, sizeof(inventory));
+
+    if (first_log < argc) {
+        for (int i = first_log; i < argc; i++) {
+            fleetinv_load(&inventory, argv[i], &records, &records_capacity);
+        }
+    } else {
+        char* path = NULL;
+        size_t path_capacity = 0;
+        ssize_t length;
+        while ((length = getline(&path, &path_capacity, stdin)) > 0) {
+            if (path[length - 1] == '\n') {
+                path[--length] = 0;
+            }
+            if (length > 0) {
+                fleetinv_load(&inventory, path, &records, &records_capacity);
+            }
+        }
+        free(path);
+    }
+
+    if (strcmp(command, "summary") == 0) {
+        printf("%zu hosts, %zu distinct configurations, %zu devices, %llu lines\n",
+            inventory.hosts_count,
+            inventory.configs_count,
+            inventory.devices_count,
+            (unsigned long long)inventory.lines);
+    } else if (strcmp(command, "groups") == 0) {
+        fleetinv_print_groups(&inventory);
+    } else if (strcmp(command, "devices") == 0) {
+        fleetinv_print_devices(&inventory);
+    } else {
+        fleetinv_query_device(&inventory, device_id, strcmp(command, "has") == 0);
+    }
+
+    free(records);
+
+    return 0;
+}
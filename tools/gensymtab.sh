@@ -0,0 +1,13 @@
+#!/bin/sh
+# Turns the output of "nm -n" on the linked kernel, read from stdin, into the
+# C symbol table used by the profiler to resolve the sampled addresses. With
+# an empty input the table is empty, which is what the first link pass uses.
+
+echo '#include <stddef.h>'
+echo '#include <stdint.h>'
+echo
+echo '#include "profiler.h"'
+echo
+echo 'const struct profiler_symbol profiler_symbols[] = {'
+awk '$2 ~ /^[Tt]$/ && $3 !~ /^\./ { printf "    { 0x%s, \"%s\" },\n", $1, $3; count++ }
+    END { if (count == 0) print "    { 0, NULL },"; print "};"; print ""; printf "const unsigned profiler_symbols_count = %d;\n", count }'